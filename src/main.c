@@ -11,6 +11,7 @@
 #include <nvs_flash.h>
 
 #include "nir_ble.h"
+#include "nir_mem.h"
 #include "nir_nvs.h"
 #include "nir_timer.h"
 
@@ -48,5 +49,8 @@ void app_main() {
 
     nir_init();
 
+    nir_mem_report();
+    nir_mem_init_done();
+
     ESP_LOGI(TAG, "/app_main");
 }
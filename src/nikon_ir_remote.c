@@ -1,27 +1,109 @@
+#include <esp_task_wdt.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 #include <nimble/nimble_port_freertos.h>
 
 #include "nikon_ir_remote.h"
 
 #include "nir_nvs.h"
 #include "nir_ble.h"
+#include "nir_learn.h"
+#include "nir_pm.h"
+#include "nir_preset.h"
+#include "nir_schedule.h"
+#include "nir_serial.h"
+#include "nir_settings.h"
 #include "nir_timer.h"
 
-static const char* _nir_enabled_key = "nir_enabled";
-static const char* _nir_delayms_key = "nir_delayms";
-
 bool _nir_enabled = 0;
 uint16_t _nir_delayms = 10000;
 
+typedef enum {
+    NIR_SEQUENCE_NONE,
+    NIR_SEQUENCE_BURST,
+    NIR_SEQUENCE_BULB,
+} _nir_sequence_t;
+
+volatile _nir_sequence_t _nir_sequence = NIR_SEQUENCE_NONE;
+uint32_t _nir_bulbms = 0;
+
+uint16_t _nir_carrierhz = 38000;
+uint16_t _nir_duty = 33;
+
+uint16_t _nir_protocol = 0;
+uint16_t _nir_preset = NIR_PRESET_NONE;
+
+void _nir_init_pm(void);
 void _nir_init_timer(void);
 void _nir_init_ble(void);
 void _nir_init_application_state(void);
+void _nir_init_control(void);
+void _nir_control_task(void* param);
+void _nir_control_run(void);
 
 uint64_t _ms_to_us(uint16_t ms);
+void _nir_timelapse_start(void);
+void _nir_stop_sequence(void);
+void _nir_sequence_done(void);
 
 void nir_init(void) {
+    nir_settings_init();
+
+    // the NimBLE bond store lives in NVS, open it before the host syncs
+    nir_init_nvs();
+
+    _nir_init_pm();
     _nir_init_timer();
     _nir_init_ble();
     _nir_init_application_state();
+    _nir_init_control();
+
+#ifdef NIR_SERIAL
+    nir_serial_init();
+#endif
+}
+
+void _nir_init_pm(void) {
+    nir_pm_init();
+}
+
+static StaticTask_t _nir_control_task_buffer;
+static StackType_t _nir_control_task_stack[NIR_CONTROL_TASK_STACK];
+static TaskHandle_t _nir_control_task_handle = NULL;
+
+void _nir_init_control(void) {
+    _nir_control_task_handle = xTaskCreateStatic(_nir_control_task, "nir_control", NIR_CONTROL_TASK_STACK, NULL, 5,
+        _nir_control_task_stack, &_nir_control_task_buffer);
+}
+
+void nir_control_notify(void) {
+    if (_nir_control_task_handle) {
+        xTaskNotifyGive(_nir_control_task_handle);
+    }
+}
+
+// One pass of the control task: window boundaries with the settings locked,
+// then the shot schedule.
+void _nir_control_run(void) {
+    nir_settings_lock();
+    nir_schedule_service();
+    nir_settings_unlock();
+
+    nir_timer_supervise();
+}
+
+// Supervises the shot schedule under the task watchdog, woken early by
+// nir_control_notify. A stall in the timer path is recovered in place here
+// instead of rebooting.
+void _nir_control_task(void* param) {
+    ESP_ERROR_CHECK(esp_task_wdt_add(NULL));
+
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(NIR_CONTROL_INTERVAL_MS));
+        _nir_control_run();
+
+        esp_task_wdt_reset();
+    }
 }
 
 void _nir_init_timer(void) {
@@ -34,10 +116,10 @@ void _nir_init_ble(void) {
 }
 
 void _nir_init_application_state(void) {
-    nir_init_nvs();
-
-    nir_set_enabled(nir_nvs_read_bool(_nir_enabled_key, false));
-    nir_set_delayms(nir_nvs_read_uint16(_nir_delayms_key, 10000));
+    nir_learn_init();
+    nir_schedule_init();
+    nir_presets_load();
+    nir_settings_load();
 }
 
 bool nir_get_enabled(void) {
@@ -51,24 +133,47 @@ void nir_set_enabled(bool enabled) {
         return; // nothing to do
     }
 
+    // timelapse takes over the timer from any burst or bulb exposure
+    _nir_stop_sequence();
+
     // update timer state
     if (_nir_enabled) {
         nir_timer_stop();
     } else {
-        nir_timer_start(_ms_to_us(_nir_delayms));
+        _nir_timelapse_start();
     }
 
     // current state
     _nir_enabled = enabled;
-
-    // store state
-    nir_nvs_write_bool(_nir_enabled_key, _nir_enabled);
 }
 
 inline uint64_t _ms_to_us(uint16_t ms) {
     return ms * 1000;
 }
 
+// Shoot now, or from the opening of the next scheduling window with the
+// first shot on its boundary.
+void _nir_timelapse_start(void) {
+    int64_t openus = nir_schedule_open_in_us();
+
+    if (openus == NIR_SCHEDULE_NEVER) {
+        ESP_LOGI(TAG, "_nir_timelapse_start: no window ahead");
+    } else if (openus) {
+        nir_timer_start_at(openus, _ms_to_us(_nir_delayms));
+    } else {
+        nir_timer_start(_ms_to_us(_nir_delayms));
+    }
+}
+
+void nir_reschedule(void) {
+    if (!_nir_enabled) {
+        return; // nothing to do
+    }
+
+    nir_timer_stop();
+    _nir_timelapse_start();
+}
+
 uint16_t nir_get_delayms(void) {
     return _nir_delayms;
 }
@@ -92,9 +197,222 @@ void nir_set_delayms(uint16_t delayms) {
 
     // start if originally enabled
     if (enabled) {
-        nir_timer_start(_ms_to_us(_nir_delayms));
+        _nir_timelapse_start();
+    }
+}
+
+uint16_t nir_get_burst(void) {
+    return _nir_sequence == NIR_SEQUENCE_BURST ? nir_timer_frames_remaining() : 0;
+}
+
+void nir_set_burst(uint16_t frames) {
+    ESP_LOGI(TAG, "nir_set_burst: %u", frames);
+
+    if (_nir_enabled) {
+        ESP_LOGW(TAG, "nir_set_burst: timelapse enabled, ignoring");
+        return;
+    }
+
+    _nir_stop_sequence();
+
+    if (!frames) {
+        return; // stop only
+    }
+
+    _nir_sequence = NIR_SEQUENCE_BURST;
+    nir_timer_start_burst(frames, _nir_sequence_done);
+}
+
+uint32_t nir_get_bulbms(void) {
+    return _nir_sequence == NIR_SEQUENCE_BULB ? _nir_bulbms : 0;
+}
+
+void nir_set_bulbms(uint32_t exposurems) {
+    ESP_LOGI(TAG, "nir_set_bulbms: %u", exposurems);
+
+    if (_nir_enabled) {
+        ESP_LOGW(TAG, "nir_set_bulbms: timelapse enabled, ignoring");
+        return;
+    }
+
+    bool open = _nir_sequence == NIR_SEQUENCE_BULB && nir_timer_frames_remaining() == 1;
+
+    _nir_stop_sequence();
+
+    if (!exposurems) {
+        // close an open shutter now rather than leave it exposing
+        if (open) {
+            _nir_sequence = NIR_SEQUENCE_BURST;
+            nir_timer_start_burst(1, _nir_sequence_done);
+        }
+        return;
+    }
+
+    _nir_bulbms = exposurems;
+    _nir_sequence = NIR_SEQUENCE_BULB;
+    nir_timer_start_bulb((uint64_t) exposurems * 1000, _nir_sequence_done);
+}
+
+void _nir_stop_sequence(void) {
+    if (_nir_sequence == NIR_SEQUENCE_NONE) {
+        return; // nothing to do
+    }
+
+    nir_timer_stop();
+    _nir_sequence = NIR_SEQUENCE_NONE;
+}
+
+void _nir_sequence_done(void) {
+    ESP_LOGI(TAG, "_nir_sequence_done");
+
+    _nir_sequence = NIR_SEQUENCE_NONE;
+}
+
+uint16_t nir_get_carrierhz(void) {
+    return _nir_carrierhz;
+}
+
+void nir_set_carrierhz(uint16_t carrierhz) {
+    ESP_LOGI(TAG, "nir_set_carrierhz(%u): %u", _nir_carrierhz, carrierhz);
+
+    _nir_carrierhz = carrierhz;
+    nir_timer_set_carrier(_nir_carrierhz, _nir_duty);
+}
+
+uint16_t nir_get_duty(void) {
+    return _nir_duty;
+}
+
+void nir_set_duty(uint16_t duty) {
+    ESP_LOGI(TAG, "nir_set_duty(%u): %u", _nir_duty, duty);
+
+    _nir_duty = duty;
+    nir_timer_set_carrier(_nir_carrierhz, _nir_duty);
+}
+
+uint16_t nir_get_protocol(void) {
+    return _nir_protocol;
+}
+
+void nir_set_protocol(uint16_t protocol) {
+    ESP_LOGI(TAG, "nir_set_protocol(%u): %u", _nir_protocol, protocol);
+
+    const nir_code_t* code = nir_code_get(protocol);
+    if (!code) {
+        ESP_LOGW(TAG, "nir_set_protocol: no code %u", protocol);
+        return;
+    }
+
+    if (_nir_protocol == protocol) {
+        return; // nothing to do
+    }
+
+    // the frame being clocked out is encoded from the current code, swap it
+    // with the timer stopped, a burst or bulb exposure is cut short
+    bool enabled = _nir_enabled;
+    _nir_stop_sequence();
+    if (enabled) {
+        nir_timer_stop();
+    }
+
+    _nir_protocol = protocol;
+    nir_timer_set_code(code);
+
+    // a learned code plays back on the carrier it was captured with
+    if (protocol >= NIR_CODES_BUILTIN) {
+        _nir_carrierhz = code->carrier_hz;
+        _nir_duty = code->duty_percent;
+        nir_timer_set_carrier(_nir_carrierhz, _nir_duty);
+    }
+
+    if (enabled) {
+        _nir_timelapse_start();
+    }
+}
+
+uint16_t nir_get_preset(void) {
+    return _nir_preset;
+}
+
+void nir_set_preset(uint16_t preset) {
+    ESP_LOGI(TAG, "nir_set_preset(%u): %u", _nir_preset, preset);
+
+    _nir_preset = preset;
+
+    const nir_preset_t* value = nir_preset_get(preset);
+    if (!value) {
+        return; // individual settings in effect
+    }
+
+    ESP_LOGI(TAG, "nir_set_preset: %.*s", NIR_PRESET_NAME_LEN, value->name);
+
+    // apply every field under a single stop/start of the timer, the code is
+    // swapped as in nir_set_protocol so a burst or bulb exposure is cut short
+    bool enabled = _nir_enabled;
+    _nir_stop_sequence();
+    if (enabled) {
+        nir_timer_stop();
+    }
+
+    _nir_delayms = value->delayms;
+    const nir_code_t* code = nir_code_get(value->protocol);
+    if (code) {
+        _nir_protocol = value->protocol;
+        nir_timer_set_code(code);
+    }
+    _nir_carrierhz = value->carrierhz;
+    _nir_duty = value->duty;
+    nir_timer_set_carrier(_nir_carrierhz, _nir_duty);
+
+    if (enabled) {
+        _nir_timelapse_start();
+    }
+}
+
+void nir_save_preset(uint16_t preset) {
+    const nir_preset_t* current = nir_preset_get(preset);
+    if (!current) {
+        return;
     }
 
-    // store state
-    nir_nvs_write_uint16(_nir_delayms_key, _nir_delayms);
+    nir_preset_t value = *current;
+    value.delayms = _nir_delayms;
+    value.carrierhz = _nir_carrierhz;
+    value.protocol = _nir_protocol;
+    value.duty = _nir_duty;
+
+    nir_preset_save(preset, &value);
+}
+
+uint16_t nir_get_learn(void) {
+    return nir_learn_status();
+}
+
+void nir_set_learn(uint16_t learn) {
+    ESP_LOGI(TAG, "nir_set_learn: %u", learn);
+
+    switch (learn) {
+        case NIR_LEARN_CMD_STOP:
+            nir_learn_stop();
+            break;
+        case NIR_LEARN_CMD_START:
+            nir_learn_start();
+            break;
+        case NIR_LEARN_CMD_CLEAR:
+            nir_learn_clear();
+
+            // learned code being transmitted is gone
+            if (_nir_protocol >= NIR_CODES_BUILTIN) {
+                nir_set_protocol(0);
+            }
+            break;
+    }
+}
+
+uint32_t nir_get_recoveries(void) {
+    return nir_timer_get_recoveries() + nir_ble_get_adv_retries();
+}
+
+uint32_t nir_get_missed(void) {
+    return nir_timer_get_missed();
 }
@@ -6,12 +6,45 @@
 
 #define LED_PIN 1
 
+/// 1 second between control task supervision passes, well inside the task watchdog timeout
+#define NIR_CONTROL_INTERVAL_MS (1000)
+#define NIR_CONTROL_TASK_STACK (3072)
+
 void nir_init(void);
 
+/// wake the control task ahead of its interval, from tasks and timer callbacks
+void nir_control_notify(void);
+
 bool nir_get_enabled(void);
 void nir_set_enabled(bool enabled);
+void nir_reschedule(void);
 
 uint16_t nir_get_delayms(void);
 void nir_set_delayms(uint16_t delayms);
 
+uint16_t nir_get_burst(void);
+void nir_set_burst(uint16_t frames);
+
+uint32_t nir_get_bulbms(void);
+void nir_set_bulbms(uint32_t exposurems);
+
+uint16_t nir_get_carrierhz(void);
+void nir_set_carrierhz(uint16_t carrierhz);
+
+uint16_t nir_get_duty(void);
+void nir_set_duty(uint16_t duty);
+
+uint16_t nir_get_protocol(void);
+void nir_set_protocol(uint16_t protocol);
+
+uint16_t nir_get_preset(void);
+void nir_set_preset(uint16_t preset);
+void nir_save_preset(uint16_t preset);
+
+uint16_t nir_get_learn(void);
+void nir_set_learn(uint16_t learn);
+
+uint32_t nir_get_recoveries(void);
+uint32_t nir_get_missed(void);
+
 #endif // NIKON_IR_REMOTE_H
@@ -1,6 +1,13 @@
 #include "nir_ble.h"
+#include "nir_mem.h"
+#include "nir_nvs.h"
+#include "nir_settings.h"
+#include "nir_trace.h"
 
+#include <inttypes.h>
+#include <stdio.h>
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <esp_nimble_hci.h>
 #include <nimble/nimble_port.h>
 #include <nimble/nimble_port_freertos.h>
@@ -19,144 +26,445 @@ const ble_uuid128_t nir_service_uuid = {
     .value = { 0xFF, 0xEE, 0xDD, 0xCC, 0xBB, 0xAA, 0x99, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0x00 },
 };
 
-// Characteristic: Enabled
-const ble_uuid128_t nir_enabled_uuid = {
-    .u = { .type = BLE_UUID_TYPE_128 },
-    .value = { 0xFF, 0xEE, 0xDD, 0xCC, 0xBB, 0xAA, 0x99, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0x01 },
-};
-
-// Characteristic: Delay MS
-const ble_uuid128_t nir_delayms_uuid = {
-    .u = { .type = BLE_UUID_TYPE_128 },
-    .value = { 0xFF, 0xEE, 0xDD, 0xCC, 0xBB, 0xAA, 0x99, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0x02 }
-};
-
 uint8_t nir_addr_type;
-uint16_t nir_conn_handle;
+uint16_t nir_conn_handle = BLE_HS_CONN_HANDLE_NONE;
+uint8_t nir_tx_phy = 0;
+uint8_t nir_rx_phy = 0;
+
+static uint64_t _nir_adv_backoffus = NIR_ADV_RETRY_MIN_US;
+static uint32_t _nir_adv_retries = 0;
+static bool _nir_adv_slow = false;
+
+/// reconnect latency, measured from a disconnect to the central's first access
+static int64_t _nir_disconnected_at = 0;
+static int64_t _nir_connected_at = 0;
+static int64_t _nir_encrypted_at = 0;
+static bool _nir_reconnect_directed = false;
+static esp_timer_handle_t _nir_adv_retry_timer;
+
+void _nir_adv_retry(void* arg);
+
+static esp_timer_create_args_t _nir_adv_retry_timer_args = {
+    .name = "adv_retry_timer",
+    .callback = _nir_adv_retry
+};
 
+void _nir_gatt_svr_init(void);
+void _nir_stop_advertising(void);
+void _nir_update_phy(uint16_t conn_handle);
 int nir_gatt_svr_chr_access(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt *ctxt, void *arg);
 int nir_ble_gap_event(struct ble_gap_event *event, void *arg);
 void nimble_error(int errno);
+void ble_store_config_init(void);
+
+// characteristics: one per nir_settings row, built by _nir_gatt_svr_init
+static struct ble_gatt_chr_def _nir_chr_defs[NIR_SETTINGS_MAX + 1];
 
 const struct ble_gatt_svc_def gatt_svr_svcs[] = { {
         // service: Nikon IR Remote
         .type = BLE_GATT_SVC_TYPE_PRIMARY,
         .uuid = &nir_service_uuid.u,
-        .characteristics = (struct ble_gatt_chr_def[]) { {
-                // characteristic: enabled
-                .uuid = &nir_enabled_uuid.u,
-                .access_cb = nir_gatt_svr_chr_access,
-                .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE,
-            }, {
-                // characteristic: delay ms
-                .uuid = &nir_delayms_uuid.u,
-                .access_cb = nir_gatt_svr_chr_access,
-                .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE,
-            }, {
-                0,
-            },
-        }
+        .characteristics = _nir_chr_defs,
     }, {
         0,
     },
 };
 
-int nir_gatt_svr_chr_access(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt *ctxt, void *arg) {
-    ESP_LOGI(TAG, "nir_enabled_gatt_svr_chr_access");
+void _nir_gatt_svr_init(void) {
+    ESP_LOGI(TAG, "_nir_gatt_svr_init: %u settings", nir_settings_count);
 
-    if (ble_uuid_cmp(ctxt->chr->uuid, &nir_enabled_uuid.u) == 0) {
-        ESP_LOGI(TAG, "nir_enabled_uuid");
+    memset(_nir_chr_defs, 0, sizeof _nir_chr_defs);
 
-        if (ctxt->op == BLE_GATT_ACCESS_OP_WRITE_CHR) {
-            ESP_LOGI(TAG, "write");
-            bool enabled;
+    for (uint16_t i = 0; i < nir_settings_count; i++) {
+        _nir_chr_defs[i].uuid = &nir_settings[i].uuid.u;
+        _nir_chr_defs[i].access_cb = nir_gatt_svr_chr_access;
+        _nir_chr_defs[i].arg = (void *) &nir_settings[i];
+        _nir_chr_defs[i].flags = BLE_GATT_CHR_F_READ | (nir_settings[i].read_only ? 0 : BLE_GATT_CHR_F_WRITE);
+    }
+}
 
-            uint16_t om_len;
-            uint16_t om_actual_len;
+// FNV-1a over the characteristic UUIDs and flags, the shape of the table a
+// bonded central caches handles for.
+static uint32_t _nir_gatt_db_hash(void) {
+    uint32_t hash = 2166136261u;
 
-            om_len = OS_MBUF_PKTLEN(ctxt->om);
-            if (om_len != sizeof enabled) {
-                return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
-            }
+    for (const struct ble_gatt_chr_def* chr = _nir_chr_defs; chr->uuid; chr++) {
+        const uint8_t* value = BLE_UUID128(chr->uuid)->value;
+        for (uint16_t i = 0; i < 16; i++) {
+            hash = (hash ^ value[i]) * 16777619u;
+        }
+        hash = (hash ^ chr->flags) * 16777619u;
+    }
 
-            int rc = ble_hs_mbuf_to_flat(ctxt->om, &enabled, sizeof enabled, &om_actual_len);
-            ESP_LOGI(TAG, "enabled: %d", enabled);
+    return hash;
+}
 
-            nir_set_enabled(enabled);
-            return rc == 0 ? 0 : BLE_ATT_ERR_UNLIKELY;
-        } else if (ctxt->op == BLE_GATT_ACCESS_OP_READ_CHR) {
-            ESP_LOGI(TAG, "read");
-            uint16_t enabled = nir_get_enabled();
+// A firmware update that changes the table would leave bonded centrals with
+// stale handles, so tell them through Service Changed, which NimBLE indicates
+// now or on their next connection.
+static void _nir_gatt_db_check(void) {
+    uint32_t hash = _nir_gatt_db_hash();
+    uint32_t cached = nir_nvs_read_uint32(NIR_GATT_DB_HASH_NVS_KEY, 0);
 
-            ESP_LOGI(TAG, "enabled: %d", enabled);
+    if (hash == cached) {
+        return; // nothing to do
+    }
 
-            int rc = os_mbuf_append(ctxt->om, &enabled, sizeof enabled);
+    ESP_LOGI(TAG, "gatt database changed: %08x -> %08x", cached, hash);
 
-            return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
-        }
-    } else if (ble_uuid_cmp(ctxt->chr->uuid, &nir_delayms_uuid.u) == 0) {
-        ESP_LOGI(TAG, "nir_delayms_uuid");
-
-        if (ctxt->op == BLE_GATT_ACCESS_OP_WRITE_CHR) {
-            ESP_LOGI(TAG, "write");
-            uint16_t delayms;
-            uint16_t om_len;
-            uint16_t om_actual_len;
-
-            om_len = OS_MBUF_PKTLEN(ctxt->om);
-            if (om_len != sizeof delayms) {
-                ESP_LOGE(TAG, "invalid length: %d, expected: %d", om_len, sizeof delayms);
-                return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
-            }
+    ble_svc_gatt_changed(0x0001, 0xFFFF);
+    nir_nvs_write_uint32(NIR_GATT_DB_HASH_NVS_KEY, hash);
+}
+
+// A central that is ready to use the service accesses it. With cached
+// handles that follows encryption directly, without service discovery.
+static void _nir_reconnect_ready(uint16_t conn_handle) {
+    if (!_nir_disconnected_at || conn_handle == BLE_HS_CONN_HANDLE_NONE) {
+        return; // not a reconnect, or a local access
+    }
+
+    int64_t now = esp_timer_get_time();
+
+    // one JSON object per line so builds with and without fast reconnect can be compared
+    printf("NIR_RECONNECT {\"directed\":%s,\"connect_ms\":%" PRId64 ",\"encrypt_ms\":%" PRId64 ",\"ready_ms\":%" PRId64 "}\n",
+        _nir_reconnect_directed ? "true" : "false",
+        _nir_connected_at ? (_nir_connected_at - _nir_disconnected_at) / 1000 : -1,
+        _nir_encrypted_at ? (_nir_encrypted_at - _nir_disconnected_at) / 1000 : -1,
+        (now - _nir_disconnected_at) / 1000);
+
+    _nir_disconnected_at = 0;
+}
+
+int nir_gatt_svr_chr_access(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt *ctxt, void *arg) {
+    const nir_setting_t* setting = arg;
+    uint8_t value[sizeof (uint32_t)];
+    int rc;
 
-            int rc = ble_hs_mbuf_to_flat(ctxt->om, &delayms, sizeof delayms, &om_actual_len);
-            ESP_LOGI(TAG, "delayms: %u", delayms);
+    ESP_LOGD(TAG, "nir_gatt_svr_chr_access: %s", setting->name);
 
-            nir_set_delayms(delayms);
+    _nir_reconnect_ready(conn_handle);
 
-            return rc == 0 ? 0 : BLE_ATT_ERR_UNLIKELY;
-        } else if (ctxt->op == BLE_GATT_ACCESS_OP_READ_CHR) {
-            ESP_LOGI(TAG, "read");
-            
-            uint16_t delayms = nir_get_delayms();
-            ESP_LOGI(TAG, "delayms: %u", delayms);
+    if (ctxt->op == BLE_GATT_ACCESS_OP_WRITE_CHR) {
+        ESP_LOGD(TAG, "write");
+        uint16_t om_len;
+        uint16_t om_actual_len;
 
-            int rc = os_mbuf_append(ctxt->om, &delayms, sizeof delayms);
+        om_len = OS_MBUF_PKTLEN(ctxt->om);
+        if (om_len != nir_setting_size(setting)) {
+            ESP_LOGE(TAG, "invalid length: %d, expected: %d", om_len, nir_setting_size(setting));
+            return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+        }
+
+        rc = ble_hs_mbuf_to_flat(ctxt->om, value, om_len, &om_actual_len);
+        if (rc != 0) {
+            return BLE_ATT_ERR_UNLIKELY;
+        }
 
-            return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+#ifdef NIR_TRACE
+        nir_trace_gatt(setting, ctxt->op, value, om_actual_len);
+#endif
+
+        switch (nir_setting_write(setting, value, om_actual_len)) {
+            case NIR_SETTING_OK:
+                return 0;
+            case NIR_SETTING_INVALID_LENGTH:
+                return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+            case NIR_SETTING_OUT_OF_RANGE:
+                return BLE_ATT_ERR_VALUE_NOT_ALLOWED;
+            case NIR_SETTING_READ_ONLY:
+                return BLE_ATT_ERR_WRITE_NOT_PERMITTED;
         }
+    } else if (ctxt->op == BLE_GATT_ACCESS_OP_READ_CHR) {
+        ESP_LOGD(TAG, "read");
+
+#ifdef NIR_TRACE
+        nir_trace_gatt(setting, ctxt->op, NULL, 0);
+#endif
+
+        uint16_t len = nir_setting_read(setting, value);
+        rc = os_mbuf_append(ctxt->om, value, len);
+
+        return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
     }
 
     return BLE_ATT_ERR_UNLIKELY;
 }
 
-void nir_advertise(void) {
-    ESP_LOGI(TAG, "nir_advertise");
+#if MYNEWT_VAL(BLE_EXT_ADV)
+// Instance 0 is legacy 1M advertising every central can see, instance 1 is
+// extended advertising on LE Coded for long range. Centrals without Coded
+// support simply never see instance 1 and connect over instance 0.
+void _nir_ext_adv_params(uint8_t instance, struct ble_gap_ext_adv_params* params) {
+    memset(params, 0, sizeof *params);
+    params->connectable = 1;
+    params->own_addr_type = nir_addr_type;
+    params->tx_power = NIR_ADV_TX_POWER;
+    params->sid = instance;
+
+    if (instance == NIR_ADV_INSTANCE_CODED) {
+        params->primary_phy = BLE_HCI_LE_PHY_CODED;
+        params->secondary_phy = BLE_HCI_LE_PHY_CODED;
+        params->itvl_min = BLE_GAP_ADV_FAST_INTERVAL2_MIN;
+        params->itvl_max = BLE_GAP_ADV_FAST_INTERVAL2_MAX;
+    } else {
+        params->legacy_pdu = 1;
+        params->scannable = 1;
+        params->primary_phy = BLE_HCI_LE_PHY_1M;
+        params->secondary_phy = BLE_HCI_LE_PHY_1M;
+        params->itvl_min = BLE_GAP_ADV_FAST_INTERVAL1_MIN;
+        params->itvl_max = BLE_GAP_ADV_FAST_INTERVAL1_MAX;
+    }
+
+    if (_nir_adv_slow) {
+        params->itvl_min = NIR_ADV_SLOW_INTERVAL;
+        params->itvl_max = NIR_ADV_SLOW_INTERVAL;
+    }
+}
+
+int _nir_ext_advertise(uint8_t instance, const struct ble_hs_adv_fields* fields) {
+    struct ble_gap_ext_adv_params params;
+    struct os_mbuf* data;
+    int8_t selected_tx_power = 0;
+    int rc;
+
+    _nir_ext_adv_params(instance, &params);
+
+    rc = ble_gap_ext_adv_configure(instance, &params, &selected_tx_power, nir_ble_gap_event, NULL);
+    nimble_error(rc);
+    if (rc) {
+        return rc;
+    }
+
+    ESP_LOGI(TAG, "ble_gap_ext_adv_configure instance: %u tx_power: %d dBm", instance, selected_tx_power);
+
+    data = os_msys_get_pkthdr(BLE_HS_ADV_MAX_SZ, 0);
+    if (!data) {
+        return BLE_HS_ENOMEM;
+    }
+
+    rc = ble_hs_adv_set_fields_mbuf(fields, data);
+    if (rc) {
+        os_mbuf_free_chain(data);
+        return rc;
+    }
+
+    ESP_LOGI(TAG, "ble_gap_ext_adv_set_data instance: %u", instance);
+    rc = ble_gap_ext_adv_set_data(instance, data);
+    nimble_error(rc);
+    if (rc) {
+        return rc;
+    }
+
+    ESP_LOGI(TAG, "ble_gap_ext_adv_start instance: %u", instance);
+    rc = ble_gap_ext_adv_start(instance, 0, 0);
+    nimble_error(rc);
+
+    return rc;
+}
+#endif
+
+int _nir_advertise_start(void) {
     int rc;
     struct ble_hs_adv_fields fields;
-    struct ble_gap_adv_params adv_params;
 
     memset(&fields, 0, sizeof fields);
     fields.name = (uint8_t *) nir_device_name;
     fields.name_len = strlen(nir_device_name);
     fields.name_is_complete = 1;
 
+#if MYNEWT_VAL(BLE_EXT_ADV)
+    // controllers without LE Coded reject the configuration, 1M keeps working
+    if (_nir_ext_advertise(NIR_ADV_INSTANCE_CODED, &fields)) {
+        ESP_LOGW(TAG, "nir_advertise: LE Coded unavailable, 1M only");
+    }
+
+    rc = _nir_ext_advertise(NIR_ADV_INSTANCE_1M, &fields);
+#else
+    struct ble_gap_adv_params adv_params;
+
     ESP_LOGI(TAG, "ble_gap_adv_set_fields");
     rc = ble_gap_adv_set_fields(&fields);
     nimble_error(rc);
+    if (rc) {
+        return rc;
+    }
 
     memset(&adv_params, 0, sizeof adv_params);
     adv_params.conn_mode = BLE_GAP_CONN_MODE_UND;
     adv_params.disc_mode = BLE_GAP_DISC_MODE_GEN;
+    if (_nir_adv_slow) {
+        adv_params.itvl_min = NIR_ADV_SLOW_INTERVAL;
+        adv_params.itvl_max = NIR_ADV_SLOW_INTERVAL;
+    }
 
     ESP_LOGI(TAG, "ble_gap_adv_start");
     rc = ble_gap_adv_start(nir_addr_type, NULL, BLE_HS_FOREVER, &adv_params, nir_ble_gap_event, NULL);
     nimble_error(rc);
+#endif
+
+    return rc;
+}
+
+#ifdef NIR_BLE_FAST_RECONNECT
+// High duty directed advertising to the bonded central that just left, so it
+// reconnects within milliseconds instead of waiting for a scan to find us.
+// Falls back to nir_advertise when it times out.
+int _nir_advertise_directed(const ble_addr_t* peer) {
+    int rc;
+
+    ESP_LOGI(TAG, "_nir_advertise_directed");
+
+#if MYNEWT_VAL(BLE_EXT_ADV)
+    struct ble_gap_ext_adv_params params;
+
+    memset(&params, 0, sizeof params);
+    params.connectable = 1;
+    params.directed = 1;
+    params.high_duty_directed = 1;
+    params.legacy_pdu = 1;
+    params.own_addr_type = nir_addr_type;
+    params.peer = *peer;
+    params.tx_power = NIR_ADV_TX_POWER;
+    params.sid = NIR_ADV_INSTANCE_1M;
+    params.primary_phy = BLE_HCI_LE_PHY_1M;
+    params.secondary_phy = BLE_HCI_LE_PHY_1M;
+
+    int8_t selected_tx_power = 0;
+
+    rc = ble_gap_ext_adv_configure(NIR_ADV_INSTANCE_1M, &params, &selected_tx_power, nir_ble_gap_event, NULL);
+    nimble_error(rc);
+    if (rc) {
+        return rc;
+    }
+
+    ESP_LOGI(TAG, "_nir_advertise_directed tx_power: %d dBm", selected_tx_power);
+
+    // duration in 10 ms units
+    rc = ble_gap_ext_adv_start(NIR_ADV_INSTANCE_1M, NIR_ADV_DIRECTED_MS / 10, 0);
+    nimble_error(rc);
+#else
+    struct ble_gap_adv_params adv_params;
+
+    memset(&adv_params, 0, sizeof adv_params);
+    adv_params.conn_mode = BLE_GAP_CONN_MODE_DIR;
+    adv_params.disc_mode = BLE_GAP_DISC_MODE_NON;
+    adv_params.high_duty_cycle = 1;
+
+    rc = ble_gap_adv_start(nir_addr_type, peer, NIR_ADV_DIRECTED_MS, &adv_params, nir_ble_gap_event, NULL);
+    nimble_error(rc);
+#endif
+
+    return rc;
+}
+#endif
+
+void nir_advertise(void) {
+    ESP_LOGI(TAG, "nir_advertise");
+
+    int rc = _nir_advertise_start();
+
+    if (rc == 0 || rc == BLE_HS_EALREADY) {
+        _nir_adv_backoffus = NIR_ADV_RETRY_MIN_US;
+        return;
+    }
+
+    // retry rather than stay invisible until the next reboot
+    _nir_adv_retries++;
+    ESP_LOGW(TAG, "nir_advertise: retry %u in %" PRIu64 " us", _nir_adv_retries, _nir_adv_backoffus);
+
+    esp_timer_stop(_nir_adv_retry_timer);
+    esp_timer_start_once(_nir_adv_retry_timer, _nir_adv_backoffus);
+
+    _nir_adv_backoffus *= 2;
+    if (_nir_adv_backoffus > NIR_ADV_RETRY_MAX_US) {
+        _nir_adv_backoffus = NIR_ADV_RETRY_MAX_US;
+    }
+}
+
+void _nir_adv_retry(void* arg) {
+    // a central may have connected in the meantime
+    if (nir_conn_handle != BLE_HS_CONN_HANDLE_NONE) {
+        return;
+    }
+
+    nir_advertise();
+}
+
+uint32_t nir_ble_get_adv_retries(void) {
+    return _nir_adv_retries;
+}
+
+// Outside a scheduling window nothing is shooting, so a central can wait
+// longer to find the device while the radio sleeps more.
+void nir_ble_set_adv_slow(bool slow) {
+    if (_nir_adv_slow == slow) {
+        return; // nothing to do
+    }
+
+    ESP_LOGI(TAG, "nir_ble_set_adv_slow: %d", slow);
+    _nir_adv_slow = slow;
+
+    // picked up by the next advertising start
+    if (!ble_hs_synced() || nir_conn_handle != BLE_HS_CONN_HANDLE_NONE) {
+        return;
+    }
+
+    _nir_stop_advertising();
+    nir_advertise();
+}
+
+void _nir_stop_advertising(void) {
+#if MYNEWT_VAL(BLE_EXT_ADV)
+    // the instance that connected has already stopped
+    if (ble_gap_ext_adv_active(NIR_ADV_INSTANCE_1M)) {
+        ble_gap_ext_adv_stop(NIR_ADV_INSTANCE_1M);
+    }
+    if (ble_gap_ext_adv_active(NIR_ADV_INSTANCE_CODED)) {
+        ble_gap_ext_adv_stop(NIR_ADV_INSTANCE_CODED);
+    }
+#else
+    if (ble_gap_adv_active()) {
+        ble_gap_adv_stop();
+    }
+#endif
+}
+
+void _nir_update_phy(uint16_t conn_handle) {
+    int rc = ble_gap_read_le_phy(conn_handle, &nir_tx_phy, &nir_rx_phy);
+    nimble_error(rc);
+
+    ESP_LOGI(TAG, "phy tx: %u rx: %u", nir_tx_phy, nir_rx_phy);
+
+#if MYNEWT_VAL(BLE_EXT_ADV)
+    // a central that connected over LE Coded supports it, keep the link there
+    if (nir_rx_phy == BLE_HCI_LE_PHY_CODED) {
+        rc = ble_gap_set_prefered_le_phy(conn_handle, BLE_GAP_LE_PHY_CODED_MASK, BLE_GAP_LE_PHY_CODED_MASK,
+            BLE_GAP_LE_PHY_CODED_S8);
+        nimble_error(rc);
+    }
+#endif
+}
+
+uint32_t nir_ble_get_link(void) {
+    int8_t rssi = 0;
+
+    if (nir_conn_handle != BLE_HS_CONN_HANDLE_NONE) {
+        ble_gap_conn_rssi(nir_conn_handle, &rssi);
+    }
+
+    return nir_tx_phy | (nir_rx_phy << 8) | ((uint32_t) (uint8_t) rssi << 16);
 }
 
 int nir_ble_gap_event(struct ble_gap_event *event, void *arg) {
+    struct ble_gap_conn_desc desc;
+    int rc;
+
     ESP_LOGI(TAG, "nir_ble_gap_event");
 
+#ifdef NIR_TRACE
+    nir_trace_gap(event);
+#endif
+
     switch (event->type) {
         case BLE_GAP_EVENT_CONNECT:
             ESP_LOGI(TAG, "BLE_GAP_EVENT_CONNECT %s status: %d",
@@ -165,15 +473,41 @@ int nir_ble_gap_event(struct ble_gap_event *event, void *arg) {
 
             if (event->connect.status) {
                 nir_advertise();
+                break;
             }
 
+            _nir_stop_advertising();
+
             nir_conn_handle = event->connect.conn_handle;
+            _nir_connected_at = esp_timer_get_time();
+            _nir_update_phy(nir_conn_handle);
+
+            // bonded centrals re-encrypt with the stored keys, others pair
+            rc = ble_gap_security_initiate(nir_conn_handle);
+            nimble_error(rc);
             break;
 
         case BLE_GAP_EVENT_DISCONNECT:
             ESP_LOGI(TAG, "BLE_GAP_EVENT_DISCONNECT reason: %d", event->disconnect.reason);
 
-            nir_advertise();
+            nir_conn_handle = BLE_HS_CONN_HANDLE_NONE;
+            nir_tx_phy = 0;
+            nir_rx_phy = 0;
+
+            _nir_disconnected_at = esp_timer_get_time();
+            _nir_connected_at = 0;
+            _nir_encrypted_at = 0;
+            _nir_reconnect_directed = false;
+
+#ifdef NIR_BLE_FAST_RECONNECT
+            if (event->disconnect.conn.sec_state.bonded) {
+                _nir_reconnect_directed = _nir_advertise_directed(&event->disconnect.conn.peer_id_addr) == 0;
+            }
+#endif
+
+            if (!_nir_reconnect_directed) {
+                nir_advertise();
+            }
             break;
 
         case BLE_GAP_EVENT_CONN_UPDATE:
@@ -201,11 +535,21 @@ int nir_ble_gap_event(struct ble_gap_event *event, void *arg) {
             break;
 
         case BLE_GAP_EVENT_ADV_COMPLETE:
-            ESP_LOGW(TAG, "BLE_GAP_EVENT_ADV_COMPLETE unhandled");
+            ESP_LOGI(TAG, "BLE_GAP_EVENT_ADV_COMPLETE reason: %d", event->adv_complete.reason);
+
+            // directed advertising ran out without the central coming back
+            if (event->adv_complete.reason == BLE_HS_ETIMEOUT && nir_conn_handle == BLE_HS_CONN_HANDLE_NONE) {
+                _nir_reconnect_directed = false;
+                nir_advertise();
+            }
             break;
 
         case BLE_GAP_EVENT_ENC_CHANGE:
-            ESP_LOGW(TAG, "BLE_GAP_EVENT_ENC_CHANGE unhandled");
+            ESP_LOGI(TAG, "BLE_GAP_EVENT_ENC_CHANGE status: %d", event->enc_change.status);
+
+            if (event->enc_change.status == 0) {
+                _nir_encrypted_at = esp_timer_get_time();
+            }
             break;
 
         case BLE_GAP_EVENT_PASSKEY_ACTION:
@@ -233,11 +577,22 @@ int nir_ble_gap_event(struct ble_gap_event *event, void *arg) {
             break;
 
         case BLE_GAP_EVENT_REPEAT_PAIRING:
-            ESP_LOGW(TAG, "BLE_GAP_EVENT_REPEAT_PAIRING unhandled");
-            break;
+            ESP_LOGW(TAG, "BLE_GAP_EVENT_REPEAT_PAIRING");
+
+            // the central lost its bond, forget ours and pair again
+            if (ble_gap_conn_find(event->repeat_pairing.conn_handle, &desc) == 0) {
+                ble_store_util_delete_peer(&desc.peer_id_addr);
+            }
+            return BLE_GAP_REPEAT_PAIRING_RETRY;
 
         case BLE_GAP_EVENT_PHY_UPDATE_COMPLETE:
-            ESP_LOGW(TAG, "BLE_GAP_EVENT_PHY_UPDATE_COMPLETE unhandled");
+            ESP_LOGI(TAG, "BLE_GAP_EVENT_PHY_UPDATE_COMPLETE status: %d tx: %u rx: %u",
+                event->phy_updated.status, event->phy_updated.tx_phy, event->phy_updated.rx_phy);
+
+            if (event->phy_updated.status == 0) {
+                nir_tx_phy = event->phy_updated.tx_phy;
+                nir_rx_phy = event->phy_updated.rx_phy;
+            }
             break;
 
         case BLE_GAP_EVENT_EXT_DISC:
@@ -380,19 +735,28 @@ void nir_ble_hs_sync(void) {
     ESP_LOGI(TAG, "nir_ble_hs_sync");
     int rc;
 
+    // privacy: advertise and connect with a resolvable private address, the
+    // controller resolves bonded centrals through its resolving list
     ESP_LOGI(TAG, "ble_hs_id_infer_auto");
-    rc = ble_hs_id_infer_auto(0, &nir_addr_type);
+    rc = ble_hs_id_infer_auto(1, &nir_addr_type);
     nimble_error(rc);
     ESP_LOGI(TAG, "ble_hs_id_infer_auto: %u", nir_addr_type);
-    
+
+    // the identity address the private addresses are generated for
+    uint8_t id_addr_type = nir_addr_type == BLE_OWN_ADDR_RANDOM || nir_addr_type == BLE_OWN_ADDR_RPA_RANDOM_DEFAULT
+        ? BLE_ADDR_RANDOM : BLE_ADDR_PUBLIC;
     uint8_t addr_val[6] = {0};
     ESP_LOGI(TAG, "ble_hs_id_copy_addr");
-    rc = ble_hs_id_copy_addr(nir_addr_type, addr_val, NULL);
+    rc = ble_hs_id_copy_addr(id_addr_type, addr_val, NULL);
     nimble_error(rc);
     ESP_LOGI(TAG, "ble_hs_id_copy_addr: %02x:%02x:%02x:%02x:%02x:%02x",
         addr_val[0], addr_val[1], addr_val[2], addr_val[3], addr_val[4], addr_val[5]);
 
+    _nir_gatt_db_check();
+
     nir_advertise();
+
+    nir_mem_host_synced();
 }
 
 void nir_ble_hs_reset(int reason) {
@@ -411,12 +775,26 @@ void nir_ble_init(void) {
     ESP_LOGI(TAG, "nimble_port_init");
     nimble_port_init();
 
+    ESP_ERROR_CHECK(esp_timer_create(&_nir_adv_retry_timer_args, &_nir_adv_retry_timer));
+
     ble_hs_cfg.sync_cb = nir_ble_hs_sync;
     ble_hs_cfg.reset_cb = nir_ble_hs_reset;
 
+    // Just Works bonding, the keys and subscriptions persist in NVS so a
+    // returning central skips pairing and service discovery
+    ble_hs_cfg.store_status_cb = ble_store_util_status_rr;
+    ble_hs_cfg.sm_io_cap = BLE_SM_IO_CAP_NO_IO;
+    ble_hs_cfg.sm_bonding = 1;
+    ble_hs_cfg.sm_mitm = 0;
+    ble_hs_cfg.sm_sc = 1;
+    ble_hs_cfg.sm_our_key_dist = BLE_SM_PAIR_KEY_DIST_ENC | BLE_SM_PAIR_KEY_DIST_ID;
+    ble_hs_cfg.sm_their_key_dist = BLE_SM_PAIR_KEY_DIST_ENC | BLE_SM_PAIR_KEY_DIST_ID;
+
     ble_svc_gap_init();
     ble_svc_gatt_init();
 
+    _nir_gatt_svr_init();
+
     ESP_LOGI(TAG, "ble_gatts_count_cfg");
     rc = ble_gatts_count_cfg(gatt_svr_svcs);
     nimble_error(rc);
@@ -428,6 +806,8 @@ void nir_ble_init(void) {
     ESP_LOGI(TAG, "ble_svc_gap_device_name_set: %s", nir_device_name);
     rc = ble_svc_gap_device_name_set(nir_device_name);
     nimble_error(rc);
+
+    ble_store_config_init();
 }
 
 void nir_ble_host_task(void *param) {
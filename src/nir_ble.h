@@ -1,11 +1,44 @@
 #include <host/ble_hs.h>
 
 #include "nikon_ir_remote.h"
+#include "nir_settings.h"
 
 #ifndef NIR_BLE_H
 #define NIR_BLE_H
 
+/// extended advertising instances, see nir_advertise
+#define NIR_ADV_INSTANCE_1M (0)
+#define NIR_ADV_INSTANCE_CODED (1)
+
+/// advertising TX power in dBm, the S3's maximum. 127 would only mean no
+/// preference and leave the controller at its default
+#define NIR_ADV_TX_POWER (18)
+
+/// advertising restart backoff, 100 ms doubling up to 10 seconds
+#define NIR_ADV_RETRY_MIN_US (100000)
+#define NIR_ADV_RETRY_MAX_US (10000000)
+
+/// advertising interval outside a scheduling window, 1 second in 0.625 ms units
+#define NIR_ADV_SLOW_INTERVAL (1600)
+
+// Define NIR_BLE_FAST_RECONNECT to advertise directly to the last bonded
+// central after it disconnects. Undefine to measure the undirected baseline.
+#define NIR_BLE_FAST_RECONNECT
+
+/// high duty directed advertising, limited to 1.28 seconds by the spec
+#define NIR_ADV_DIRECTED_MS (1280)
+
+/// NVS key of the GATT database hash the bonded centrals have cached
+#define NIR_GATT_DB_HASH_NVS_KEY "nir_db_hash"
+
 void nir_ble_init(void);
 void nir_ble_host_task(void *param);
 
+uint32_t nir_ble_get_link(void);
+uint32_t nir_ble_get_adv_retries(void);
+void nir_ble_set_adv_slow(bool slow);
+
+int nir_gatt_svr_chr_access(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt *ctxt, void *arg);
+int nir_ble_gap_event(struct ble_gap_event *event, void *arg);
+
 #endif // NIR_BLE_H
@@ -0,0 +1,55 @@
+#include <stdlib.h>
+
+#include "nir_code.h"
+
+#include "nir_learn.h"
+
+// Built in codes, index is the protocol number.
+const nir_code_t nir_codes[NIR_CODES_BUILTIN] = { {
+        // Nikon ML-L3 shutter release
+        .name = "nikon",
+        .carrier_hz = 38000,
+        .duty_percent = 33,
+        .count = 7,
+        .durations = { 2000, 27830, 400, 1500, 400, 3500, 400 },
+        .carrier_tolerance_hz = 1000,
+        .duty_tolerance_percent = 10,
+        .duration_tolerance_us = 50,
+    }
+};
+
+const nir_code_t* nir_code_get(uint16_t protocol) {
+    if (protocol < NIR_CODES_BUILTIN) {
+        return &nir_codes[protocol];
+    }
+
+    return nir_learn_get_code(protocol - NIR_CODES_BUILTIN);
+}
+
+uint64_t nir_code_duration_us(const nir_code_t* code) {
+    uint64_t durationus = 0;
+
+    for (uint16_t i = 0; i < code->count; i++) {
+        durationus += code->durations[i];
+    }
+
+    return durationus;
+}
+
+bool nir_code_matches(const nir_code_t* code, const nir_code_t* other) {
+    if (code->count != other->count) {
+        return false;
+    }
+
+    if (abs((int32_t) code->carrier_hz - (int32_t) other->carrier_hz) > code->carrier_tolerance_hz) {
+        return false;
+    }
+
+    for (uint16_t i = 0; i < code->count; i++) {
+        if (abs((int32_t) code->durations[i] - (int32_t) other->durations[i]) > code->duration_tolerance_us) {
+            return false;
+        }
+    }
+
+    return true;
+}
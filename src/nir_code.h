@@ -0,0 +1,40 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "nikon_ir_remote.h"
+
+#ifndef NIR_CODE_H
+#define NIR_CODE_H
+
+/// marks and spaces in a single frame, NEC needs 67
+#define NIR_CODE_MAX_DURATIONS (80)
+
+/// entries in nir_codes, protocol numbers 0 to NIR_CODES_BUILTIN - 1
+#define NIR_CODES_BUILTIN (1)
+
+/// learned codes follow the built in ones as protocol numbers
+#define NIR_LEARNED_MAX (4)
+#define NIR_CODES_MAX (NIR_CODES_BUILTIN + NIR_LEARNED_MAX)
+
+// An IR frame as alternating mark/space durations in microseconds, starting
+// with a mark. The final mark is followed by the space between frames.
+typedef struct {
+    const char* name;
+    uint32_t carrier_hz;
+    uint8_t duty_percent;
+    uint16_t count;
+    uint16_t durations[NIR_CODE_MAX_DURATIONS];
+    /// conformance tolerances
+    uint16_t carrier_tolerance_hz;
+    uint8_t duty_tolerance_percent;
+    uint16_t duration_tolerance_us;
+} nir_code_t;
+
+extern const nir_code_t nir_codes[NIR_CODES_BUILTIN];
+
+const nir_code_t* nir_code_get(uint16_t protocol);
+
+uint64_t nir_code_duration_us(const nir_code_t* code);
+bool nir_code_matches(const nir_code_t* code, const nir_code_t* other);
+
+#endif // NIR_CODE_H
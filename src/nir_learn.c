@@ -0,0 +1,413 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <driver/rmt.h>
+#include <esp_log.h>
+#include <esp_pm.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/ringbuf.h>
+
+#include "nir_learn.h"
+
+#include "nir_nvs.h"
+
+extern const char *TAG;
+
+/// RX capable channels on the S3 are 4 to 7
+#define RMT_CHANNEL (RMT_CHANNEL_4)
+
+/// 40 MHz XTAL / 40, 1 us per RMT tick, the S3 clocks all channels from the
+/// same source and nir_timer uses XTAL so DFS can scale APB
+#define RMT_CLK_DIV (40)
+
+/// 4 of the S3's 48 item blocks. rmt_rx_start enables ping-pong on the S3,
+/// the driver copies out each half as it fills, so a frame is bounded by
+/// RMT_RX_BUFFER rather than by the channel's memory
+#define RMT_MEM_BLOCKS (4)
+
+/// one 4 byte RMT item per carrier cycle, a NEC frame is ~1050
+#define RMT_RX_BUFFER (8192)
+
+/// 50 XTAL cycles, 1.25 us glitch filter
+#define RMT_FILTER_TICKS (50)
+
+#define NIR_LEARN_TASK_STACK (4096)
+
+/// header plus zigzag varint deltas, at most 3 bytes per duration
+#define NIR_LEARN_BLOB_MAX (4 + NIR_CODE_MAX_DURATIONS * 3)
+
+typedef struct __attribute__((packed)) {
+    uint16_t carrier_hz;
+    uint8_t duty_percent;
+    uint8_t count;
+} _nir_learn_header_t;
+
+static nir_code_t _nir_learned[NIR_LEARNED_MAX];
+static char _nir_learned_names[NIR_LEARNED_MAX][12];
+
+static volatile uint16_t _nir_learn_status = NIR_LEARN_NONE;
+static volatile bool _nir_learn_cancel = false;
+static TaskHandle_t _nir_learn_task_handle = NULL;
+
+// created once at init and woken per capture, never deleted, kept static so
+// learning never touches the heap
+static StaticTask_t _nir_learn_task_buffer;
+static StackType_t _nir_learn_task_stack[NIR_LEARN_TASK_STACK];
+
+static esp_pm_lock_handle_t _nir_learn_pm_lock;
+
+static void _nir_learn_task(void* param);
+
+static void _nir_learn_key(uint16_t slot, char* key) {
+    snprintf(key, 16, "nir_learn%u", slot);
+}
+
+// Marks and spaces are each delta-encoded against the previous mark or space,
+// in NIR_LEARN_QUANTUM_US units, as zigzag varints. Repeated bits of a
+// protocol then take a single byte each.
+static size_t _nir_learn_encode(const nir_code_t* code, uint8_t* blob) {
+    _nir_learn_header_t header = {
+        .carrier_hz = code->carrier_hz,
+        .duty_percent = code->duty_percent,
+        .count = code->count,
+    };
+    int32_t previous[2] = { 0, 0 };
+    size_t len = sizeof header;
+
+    memcpy(blob, &header, sizeof header);
+
+    for (uint16_t i = 0; i < code->count; i++) {
+        int32_t value = code->durations[i] / NIR_LEARN_QUANTUM_US;
+        int32_t delta = value - previous[i % 2];
+        uint32_t zigzag = ((uint32_t) delta << 1) ^ (uint32_t) (delta >> 31);
+
+        previous[i % 2] = value;
+
+        do {
+            uint8_t byte = zigzag & 0x7F;
+            zigzag >>= 7;
+            blob[len++] = byte | (zigzag ? 0x80 : 0);
+        } while (zigzag);
+    }
+
+    return len;
+}
+
+static bool _nir_learn_decode(const uint8_t* blob, size_t len, nir_code_t* code) {
+    _nir_learn_header_t header;
+    int32_t previous[2] = { 0, 0 };
+    size_t offset = sizeof header;
+
+    if (len < sizeof header) {
+        return false;
+    }
+
+    memcpy(&header, blob, sizeof header);
+    if (header.count == 0 || header.count > NIR_CODE_MAX_DURATIONS) {
+        return false;
+    }
+
+    code->carrier_hz = header.carrier_hz;
+    code->duty_percent = header.duty_percent;
+    code->count = header.count;
+
+    for (uint16_t i = 0; i < header.count; i++) {
+        uint32_t zigzag = 0;
+        uint8_t shift = 0;
+        uint8_t byte;
+
+        do {
+            if (offset >= len || shift > 28) {
+                return false;
+            }
+            byte = blob[offset++];
+            zigzag |= (uint32_t) (byte & 0x7F) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+
+        int32_t delta = (int32_t) (zigzag >> 1) ^ -(int32_t) (zigzag & 1);
+        previous[i % 2] += delta;
+        code->durations[i] = previous[i % 2] * NIR_LEARN_QUANTUM_US;
+    }
+
+    return true;
+}
+
+static void _nir_learn_tolerances(nir_code_t* code) {
+    code->carrier_tolerance_hz = 1000;
+    code->duty_tolerance_percent = 10;
+    code->duration_tolerance_us = 50;
+}
+
+static void _nir_learn_defaults(uint16_t slot) {
+    nir_code_t* code = &_nir_learned[slot];
+
+    memset(code, 0, sizeof *code);
+    snprintf(_nir_learned_names[slot], sizeof _nir_learned_names[slot], "learned%u", slot);
+    code->name = _nir_learned_names[slot];
+    _nir_learn_tolerances(code);
+}
+
+static void _nir_learn_load(void) {
+    uint8_t blob[NIR_LEARN_BLOB_MAX];
+    char key[16];
+
+    for (uint16_t slot = 0; slot < NIR_LEARNED_MAX; slot++) {
+        _nir_learn_defaults(slot);
+        _nir_learn_key(slot, key);
+
+        size_t len = nir_nvs_read_blob_len(key, blob, sizeof blob);
+        if (len && !_nir_learn_decode(blob, len, &_nir_learned[slot])) {
+            ESP_LOGW(TAG, "%s: corrupt, ignoring", key);
+            _nir_learned[slot].count = 0;
+        }
+    }
+}
+
+void nir_learn_init(void) {
+    ESP_LOGI(TAG, "nir_learn_init");
+
+    rmt_config_t config = RMT_DEFAULT_CONFIG_RX(NIR_LEARN_PIN, RMT_CHANNEL);
+    config.clk_div = RMT_CLK_DIV;
+    config.mem_block_num = RMT_MEM_BLOCKS;
+    config.flags = RMT_CHANNEL_FLAGS_AWARE_DFS;
+    config.rx_config.filter_en = true;
+    config.rx_config.filter_ticks_thresh = RMT_FILTER_TICKS;
+    config.rx_config.idle_threshold = NIR_LEARN_IDLE_US;
+
+    ESP_ERROR_CHECK(rmt_config(&config));
+    ESP_ERROR_CHECK(rmt_driver_install(RMT_CHANNEL, RMT_RX_BUFFER, 0));
+
+    ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "nir_learn", &_nir_learn_pm_lock));
+
+    _nir_learn_load();
+
+    _nir_learn_task_handle = xTaskCreateStatic(_nir_learn_task, "nir_learn", NIR_LEARN_TASK_STACK, NULL, 5,
+        _nir_learn_task_stack, &_nir_learn_task_buffer);
+}
+
+void nir_learn_start(void) {
+    ESP_LOGI(TAG, "nir_learn_start");
+
+    if (_nir_learn_status == NIR_LEARN_LISTENING) {
+        return; // already listening
+    }
+
+    _nir_learn_cancel = false;
+    _nir_learn_status = NIR_LEARN_LISTENING;
+    xTaskNotifyGive(_nir_learn_task_handle);
+}
+
+void nir_learn_stop(void) {
+    ESP_LOGI(TAG, "nir_learn_stop");
+
+    _nir_learn_cancel = true;
+    xTaskNotifyGive(_nir_learn_task_handle);
+}
+
+void nir_learn_clear(void) {
+    ESP_LOGI(TAG, "nir_learn_clear");
+
+    char key[16];
+
+    for (uint16_t slot = 0; slot < NIR_LEARNED_MAX; slot++) {
+        if (!_nir_learned[slot].count) {
+            continue;
+        }
+
+        _nir_learn_defaults(slot);
+        _nir_learn_key(slot, key);
+        nir_nvs_erase(key);
+    }
+}
+
+uint16_t nir_learn_status(void) {
+    return _nir_learn_status;
+}
+
+const nir_code_t* nir_learn_get_code(uint16_t slot) {
+    if (slot >= NIR_LEARNED_MAX || !_nir_learned[slot].count) {
+        return NULL;
+    }
+
+    return &_nir_learned[slot];
+}
+
+// Turn raw receiver items back into marks and spaces. Short low periods
+// between active pulses are carrier cycles and are folded into the mark.
+// Each pulse that follows another within a mark completes a carrier period,
+// the final pulse of a mark does not, so only whole periods give the carrier
+// frequency and duty.
+static bool _nir_learn_demodulate(const rmt_item32_t* items, size_t count, nir_code_t* code, uint32_t* raw) {
+    uint32_t mark = 0;
+    uint32_t pending = 0;
+    bool in_mark = false;
+    uint32_t last_high = 0;
+    uint32_t periods = 0;
+    uint32_t period_us = 0;
+    uint32_t period_high_us = 0;
+    uint16_t n = 0;
+
+    for (size_t i = 0; i < count * 2; i++) {
+        const rmt_item32_t* item = &items[i / 2];
+        uint32_t ticks = i % 2 == 0 ? item->duration0 : item->duration1;
+        uint32_t level = i % 2 == 0 ? item->level0 : item->level1;
+
+        if (!ticks) {
+            break;
+        }
+
+        if (level == NIR_LEARN_ACTIVE_LEVEL) {
+            if (in_mark) {
+                mark += pending + ticks;
+                periods++;
+                period_us += last_high + pending;
+                period_high_us += last_high;
+            } else {
+                mark = ticks;
+                in_mark = true;
+            }
+            pending = 0;
+            last_high = ticks;
+        } else if (in_mark && ticks < NIR_LEARN_CARRIER_GAP_US) {
+            pending += ticks;
+        } else if (in_mark) {
+            if (n + 2 > NIR_CODE_MAX_DURATIONS) {
+                return false;
+            }
+            raw[n++] = mark;
+            raw[n++] = ticks;
+            in_mark = false;
+        }
+    }
+
+    if (in_mark) {
+        if (n + 1 > NIR_CODE_MAX_DURATIONS) {
+            return false;
+        }
+        raw[n++] = mark;
+    } else if (n) {
+        n--; // trailing space is the gap to the next frame
+    }
+
+    if (!n) {
+        return false;
+    }
+
+    code->count = n;
+    for (uint16_t i = 0; i < n; i++) {
+        code->durations[i] = (raw[i] + NIR_LEARN_QUANTUM_US / 2) / NIR_LEARN_QUANTUM_US * NIR_LEARN_QUANTUM_US;
+    }
+
+    if (periods) {
+        code->carrier_hz = (uint64_t) periods * 1000000 / period_us;
+        code->duty_percent = 100 * period_high_us / period_us;
+    } else {
+        // one pulse per mark, the receiver already removed the carrier
+        code->carrier_hz = NIR_LEARN_DEFAULT_CARRIER_HZ;
+        code->duty_percent = NIR_LEARN_DEFAULT_DUTY_PERCENT;
+    }
+
+    return true;
+}
+
+static uint16_t _nir_learn_store(nir_code_t* code, const uint32_t* raw) {
+    // already known, either built in or learned before
+    for (uint16_t protocol = 0; protocol < NIR_CODES_MAX; protocol++) {
+        const nir_code_t* known = nir_code_get(protocol);
+        if (known && nir_code_matches(known, code)) {
+            ESP_LOGI(TAG, "nir_learn: matches %s (%u)", known->name, protocol);
+            return protocol;
+        }
+    }
+
+    uint16_t slot = 0;
+    while (slot < NIR_LEARNED_MAX && _nir_learned[slot].count) {
+        slot++;
+    }
+
+    if (slot == NIR_LEARNED_MAX) {
+        ESP_LOGE(TAG, "nir_learn: no free slot");
+        return NIR_LEARN_NONE;
+    }
+
+    uint8_t blob[NIR_LEARN_BLOB_MAX];
+    char key[16];
+    size_t len = _nir_learn_encode(code, blob);
+
+    nir_code_t* learned = &_nir_learned[slot];
+    if (!_nir_learn_decode(blob, len, learned)) {
+        ESP_LOGE(TAG, "nir_learn: encoding failed");
+        _nir_learned[slot].count = 0;
+        return NIR_LEARN_NONE;
+    }
+
+    // what will be played back against what was captured
+    uint32_t max_error = 0;
+    for (uint16_t i = 0; i < learned->count; i++) {
+        uint32_t error = abs((int32_t) learned->durations[i] - (int32_t) raw[i]);
+        max_error = error > max_error ? error : max_error;
+    }
+
+    ESP_LOGI(TAG, "nir_learn: %s %u durations, %u Hz %u%%, %zu bytes, capture to replay max error: %u us",
+        learned->name, learned->count, learned->carrier_hz, learned->duty_percent, len, max_error);
+
+    _nir_learn_key(slot, key);
+    nir_nvs_write_blob(key, blob, len);
+
+    return NIR_CODES_BUILTIN + slot;
+}
+
+static uint16_t _nir_learn_capture(void) {
+    RingbufHandle_t ringbuf = NULL;
+    uint16_t status = NIR_LEARN_NONE;
+    TickType_t deadline = xTaskGetTickCount() + pdMS_TO_TICKS(NIR_LEARN_TIMEOUT_MS);
+
+    esp_pm_lock_acquire(_nir_learn_pm_lock);
+
+    rmt_get_ringbuf_handle(RMT_CHANNEL, &ringbuf);
+    rmt_rx_start(RMT_CHANNEL, true);
+
+    while (!_nir_learn_cancel && xTaskGetTickCount() < deadline) {
+        size_t size = 0;
+        rmt_item32_t* items = xRingbufferReceive(ringbuf, &size, pdMS_TO_TICKS(100));
+        if (!items) {
+            continue;
+        }
+
+        nir_code_t code = { .name = "capture" };
+        uint32_t raw[NIR_CODE_MAX_DURATIONS];
+
+        _nir_learn_tolerances(&code);
+        bool captured = _nir_learn_demodulate(items, size / sizeof (rmt_item32_t), &code, raw);
+
+        vRingbufferReturnItem(ringbuf, items);
+
+        if (captured) {
+            status = _nir_learn_store(&code, raw);
+            break;
+        }
+
+        ESP_LOGW(TAG, "nir_learn: unusable capture, %zu items", size / sizeof (rmt_item32_t));
+    }
+
+    rmt_rx_stop(RMT_CHANNEL);
+    esp_pm_lock_release(_nir_learn_pm_lock);
+
+    ESP_LOGI(TAG, "nir_learn: done %u", status);
+
+    return status;
+}
+
+// Resident, the task blocks until nir_learn_start or nir_learn_stop notifies
+// it. A stop while idle only wakes it, a capture runs while listening.
+static void _nir_learn_task(void* param) {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        if (_nir_learn_status == NIR_LEARN_LISTENING) {
+            _nir_learn_status = _nir_learn_capture();
+        }
+    }
+}
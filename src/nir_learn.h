@@ -0,0 +1,49 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "nikon_ir_remote.h"
+#include "nir_code.h"
+
+#ifndef NIR_LEARN_H
+#define NIR_LEARN_H
+
+/// un-demodulated IR receiver (photodiode/phototransistor), active low
+#define NIR_LEARN_PIN (2)
+#define NIR_LEARN_ACTIVE_LEVEL (0)
+
+/// 10 seconds to point a remote at the receiver
+#define NIR_LEARN_TIMEOUT_MS (10000)
+
+/// low periods shorter than this are carrier cycles within a mark, not spaces
+#define NIR_LEARN_CARRIER_GAP_US (60)
+
+/// silence that ends a captured frame, must fit a 15 bit RMT duration
+#define NIR_LEARN_IDLE_US (32000)
+
+/// learned durations are rounded to this before storing
+#define NIR_LEARN_QUANTUM_US (10)
+
+/// carrier assumed when the receiver output is already demodulated
+#define NIR_LEARN_DEFAULT_CARRIER_HZ (38000)
+#define NIR_LEARN_DEFAULT_DUTY_PERCENT (33)
+
+/// learn characteristic commands
+#define NIR_LEARN_CMD_STOP (0)
+#define NIR_LEARN_CMD_START (1)
+#define NIR_LEARN_CMD_CLEAR (2)
+
+/// nir_learn_status while capturing, or when nothing has been learned
+#define NIR_LEARN_LISTENING (0xFFFF)
+#define NIR_LEARN_NONE (0xFFFE)
+
+void nir_learn_init(void);
+
+void nir_learn_start(void);
+void nir_learn_stop(void);
+void nir_learn_clear(void);
+
+uint16_t nir_learn_status(void);
+
+const nir_code_t* nir_learn_get_code(uint16_t slot);
+
+#endif // NIR_LEARN_H
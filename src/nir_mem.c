@@ -0,0 +1,161 @@
+#include <esp_heap_caps.h>
+#include <esp_heap_trace.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "nir_mem.h"
+
+// linker symbols from the ESP-IDF sections.ld
+extern int _data_start, _data_end;
+extern int _bss_start, _bss_end;
+
+static const char* _nir_mem_tasks[] = {
+    "main",
+    "IDLE",
+    "esp_timer",
+    "nimble_host",
+    "btController",
+    "nir_control",
+    "nir_learn",
+    "nir_serial",
+    "Tmr Svc",
+    "ipc0",
+    "ipc1",
+};
+
+static uint32_t _nir_mem_violations = 0;
+
+#ifdef NIR_HEAP_GUARD
+#ifndef CONFIG_HEAP_TRACING_STANDALONE
+#error "NIR_HEAP_GUARD needs CONFIG_HEAP_TRACING_STANDALONE"
+#endif
+
+/// tracing starts once app_main has finished init and the BLE host has synced
+#define NIR_MEM_READY_INIT (1 << 0)
+#define NIR_MEM_READY_SYNCED (1 << 1)
+#define NIR_MEM_READY_ALL (NIR_MEM_READY_INIT | NIR_MEM_READY_SYNCED)
+
+static portMUX_TYPE _nir_mem_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t _nir_mem_ready = 0;
+
+static heap_trace_record_t _nir_mem_records[NIR_HEAP_GUARD_RECORDS];
+
+static esp_timer_handle_t _nir_mem_guard_timer;
+
+static void _nir_mem_guard(void* arg);
+
+static esp_timer_create_args_t _nir_mem_guard_timer_args = {
+    .name = "heap_guard_timer",
+    .callback = _nir_mem_guard
+};
+#endif
+
+static size_t _nir_mem_allocated_blocks(void) {
+    multi_heap_info_t info;
+
+    heap_caps_get_info(&info, MALLOC_CAP_DEFAULT);
+
+    return info.allocated_blocks;
+}
+
+#ifdef NIR_HEAP_GUARD
+static void _nir_mem_guard_start(void) {
+    ESP_LOGI(TAG, "nir_mem heap guard allocated blocks: %zu", _nir_mem_allocated_blocks());
+
+    // the guard's own timer is part of init
+    ESP_ERROR_CHECK(esp_timer_create(&_nir_mem_guard_timer_args, &_nir_mem_guard_timer));
+
+    ESP_ERROR_CHECK(heap_trace_init_standalone(_nir_mem_records, NIR_HEAP_GUARD_RECORDS));
+    ESP_ERROR_CHECK(heap_trace_start(HEAP_TRACE_ALL));
+
+    ESP_ERROR_CHECK(esp_timer_start_periodic(_nir_mem_guard_timer, NIR_HEAP_GUARD_INTERVAL_US));
+}
+#endif
+
+// app_main and the NimBLE host task each report in, whichever is last starts
+// the guard. A later host sync, e.g. after a controller reset, does not.
+static void _nir_mem_ready_set(uint8_t flag) {
+#ifdef NIR_HEAP_GUARD
+    portENTER_CRITICAL(&_nir_mem_lock);
+    bool start = _nir_mem_ready != NIR_MEM_READY_ALL && (_nir_mem_ready | flag) == NIR_MEM_READY_ALL;
+    _nir_mem_ready |= flag;
+    portEXIT_CRITICAL(&_nir_mem_lock);
+
+    if (start) {
+        _nir_mem_guard_start();
+    }
+#endif
+}
+
+void nir_mem_init_done(void) {
+    ESP_LOGI(TAG, "nir_mem_init_done allocated blocks: %zu", _nir_mem_allocated_blocks());
+
+    _nir_mem_ready_set(NIR_MEM_READY_INIT);
+}
+
+void nir_mem_host_synced(void) {
+    _nir_mem_ready_set(NIR_MEM_READY_SYNCED);
+}
+
+void nir_mem_report(void) {
+    ESP_LOGI(TAG, "nir_mem static ram data: %d bss: %d",
+        (int) ((char*) &_data_end - (char*) &_data_start),
+        (int) ((char*) &_bss_end - (char*) &_bss_start));
+
+    ESP_LOGI(TAG, "nir_mem heap internal free: %zu min free: %zu largest: %zu",
+        heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+        heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL),
+        heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL));
+
+    ESP_LOGI(TAG, "nir_mem heap default free: %zu min free: %zu blocks: %zu",
+        heap_caps_get_free_size(MALLOC_CAP_DEFAULT),
+        heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT),
+        _nir_mem_allocated_blocks());
+
+    for (uint32_t i = 0; i < sizeof _nir_mem_tasks / sizeof _nir_mem_tasks[0]; i++) {
+        TaskHandle_t task = xTaskGetHandle(_nir_mem_tasks[i]);
+        if (!task) {
+            continue; // not running
+        }
+
+        ESP_LOGI(TAG, "nir_mem task %s stack high water: %u", _nir_mem_tasks[i], uxTaskGetStackHighWaterMark(task));
+    }
+}
+
+uint32_t nir_mem_get_violations(void) {
+    return _nir_mem_violations;
+}
+
+#ifdef NIR_HEAP_GUARD
+// Every allocation since the last check, freed or not, with its callers.
+// Starting the trace again clears the records for the next interval.
+static void _nir_mem_guard(void* arg) {
+    heap_trace_stop();
+
+    size_t count = heap_trace_get_count();
+    for (size_t i = 0; i < count; i++) {
+        heap_trace_record_t record;
+
+        if (heap_trace_get(i, &record) != ESP_OK) {
+            break;
+        }
+
+        _nir_mem_violations++;
+        ESP_LOGW(TAG, "nir_mem heap alloc after init: %zu bytes at %p by %p %p%s, violations: %u",
+            record.size, record.address, record.alloced_by[0], record.alloced_by[1],
+            record.freed_by[0] ? " (freed)" : "", _nir_mem_violations);
+    }
+
+    if (count == NIR_HEAP_GUARD_RECORDS) {
+        ESP_LOGW(TAG, "nir_mem heap trace full, later allocations not recorded");
+    }
+
+    heap_trace_start(HEAP_TRACE_ALL);
+
+    if (count) {
+        nir_mem_report();
+    }
+}
+#endif
@@ -0,0 +1,28 @@
+#include <stdint.h>
+
+#include "nikon_ir_remote.h"
+
+#ifndef NIR_MEM_H
+#define NIR_MEM_H
+
+// Define NIR_HEAP_GUARD to trace every heap allocation made after init and
+// the BLE host sync, needs CONFIG_HEAP_TRACING_STANDALONE. A debug build
+// mode: tracing costs every allocation and the check timer wakes the chip
+// from light sleep.
+// #define NIR_HEAP_GUARD
+
+/// 10 seconds between heap guard checks
+#define NIR_HEAP_GUARD_INTERVAL_US (10000000)
+
+/// allocations traced between checks, later ones in the same interval are dropped
+#define NIR_HEAP_GUARD_RECORDS (32)
+
+extern const char *TAG;
+
+void nir_mem_init_done(void);
+void nir_mem_host_synced(void);
+void nir_mem_report(void);
+
+uint32_t nir_mem_get_violations(void);
+
+#endif // NIR_MEM_H
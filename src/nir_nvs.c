@@ -11,6 +11,9 @@ const char* NIR_NVS_NAMESPACE = "nikon_ir_remote";
 
 nvs_handle_t _nir_nvs_handle;
 
+/// every commit is a flash write, counted for control path load testing
+static uint32_t _nir_nvs_commits = 0;
+
 void nir_init_nvs(void) {
     ESP_LOGI(TAG, "nvs_flash_init");
     switch (nvs_flash_init()) {
@@ -69,8 +72,9 @@ void nir_deinit(void) {
 }
 
 bool nir_nvs_read_bool(const char* key, const bool default_value) {
-    bool value;
-    size_t len;
+    // anything but a successful read leaves the default
+    bool value = default_value;
+    size_t len = sizeof value;
 
     ESP_LOGI(TAG, "nvs_get_blob");
     switch (nvs_get_blob(_nir_nvs_handle, key, &value, &len)) {
@@ -125,6 +129,7 @@ void nir_nvs_write_bool(const char* key, const bool value) {
     }
 
     ESP_LOGI(TAG, "nvs_commit");
+    _nir_nvs_commits++;
     switch (nvs_commit(_nir_nvs_handle)) {
         case ESP_OK:
             ESP_LOGI(TAG, "NVS OK");
@@ -139,7 +144,8 @@ void nir_nvs_write_bool(const char* key, const bool value) {
 }
 
 uint16_t nir_nvs_read_uint16(const char* key, const uint16_t default_value) {
-    uint16_t value;
+    // anything but a successful read leaves the default
+    uint16_t value = default_value;
 
     ESP_LOGI(TAG, "nvs_get_u16");
     switch (nvs_get_u16(_nir_nvs_handle, key, &value)) {
@@ -194,6 +200,149 @@ void nir_nvs_write_uint16(const char* key, const uint16_t value) {
     }
 
     ESP_LOGI(TAG, "nvs_commit");
+    _nir_nvs_commits++;
+    switch (nvs_commit(_nir_nvs_handle)) {
+        case ESP_OK:
+            ESP_LOGI(TAG, "NVS OK");
+            break;
+        case ESP_ERR_NVS_INVALID_HANDLE:
+            ESP_LOGE(TAG, "NVS Invalid Handle");
+            break;
+        default:
+            ESP_LOGE(TAG, "WTFBBQ!");
+            break;
+    }
+}
+
+uint32_t nir_nvs_read_uint32(const char* key, const uint32_t default_value) {
+    // anything but a successful read leaves the default
+    uint32_t value = default_value;
+
+    ESP_LOGI(TAG, "nvs_get_u32");
+    switch (nvs_get_u32(_nir_nvs_handle, key, &value)) {
+        case ESP_OK:
+            ESP_LOGI(TAG, "NVS OK");
+            break;
+        case ESP_ERR_NVS_NOT_FOUND:
+            ESP_LOGW(TAG, "NVS Not Found");
+            value = default_value;
+            break;
+        case ESP_ERR_NVS_INVALID_HANDLE:
+            ESP_LOGE(TAG, "NVS Invalid Handle");
+            break;
+        case ESP_ERR_NVS_INVALID_NAME:
+            ESP_LOGE(TAG, "NVS Invalid Name");
+            break;
+        case ESP_ERR_NVS_INVALID_LENGTH:
+            ESP_LOGE(TAG, "NVS Invalid Length");
+            break;
+        default:
+            ESP_LOGE(TAG, "WTFBBQ!");
+            break;
+    }
+
+    return value;
+}
+
+void nir_nvs_write_uint32(const char* key, const uint32_t value) {
+    ESP_LOGI(TAG, "nvs_set_u32");
+    switch (nvs_set_u32(_nir_nvs_handle, key, value)) {
+        case ESP_OK:
+            ESP_LOGI(TAG, "NVS OK");
+            break;
+        case ESP_ERR_NVS_INVALID_HANDLE:
+            ESP_LOGE(TAG, "NVS Invalid Handle");
+            break;
+        case ESP_ERR_NVS_READ_ONLY:
+            ESP_LOGE(TAG, "NVS Read Only");
+            break;
+        case ESP_ERR_NVS_INVALID_NAME:
+            ESP_LOGE(TAG, "NVS Invalid Name");
+            break;
+        case ESP_ERR_NVS_NOT_ENOUGH_SPACE:
+            ESP_LOGE(TAG, "NVS Not Enough Space");
+            break;
+        case ESP_ERR_NVS_REMOVE_FAILED:
+            ESP_LOGE(TAG, "NVS Remove Failed");
+            break;
+        default:
+            ESP_LOGE(TAG, "WTFBBQ!");
+            break;
+    }
+
+    ESP_LOGI(TAG, "nvs_commit");
+    _nir_nvs_commits++;
+    switch (nvs_commit(_nir_nvs_handle)) {
+        case ESP_OK:
+            ESP_LOGI(TAG, "NVS OK");
+            break;
+        case ESP_ERR_NVS_INVALID_HANDLE:
+            ESP_LOGE(TAG, "NVS Invalid Handle");
+            break;
+        default:
+            ESP_LOGE(TAG, "WTFBBQ!");
+            break;
+    }
+}
+
+bool nir_nvs_read_blob(const char* key, void* value, const size_t len) {
+    size_t actual_len = len;
+    bool found = false;
+
+    ESP_LOGI(TAG, "nvs_get_blob");
+    switch (nvs_get_blob(_nir_nvs_handle, key, value, &actual_len)) {
+        case ESP_OK:
+            ESP_LOGI(TAG, "NVS OK");
+            found = actual_len == len;
+            break;
+        case ESP_ERR_NVS_NOT_FOUND:
+            ESP_LOGW(TAG, "NVS Not Found");
+            break;
+        case ESP_ERR_NVS_INVALID_HANDLE:
+            ESP_LOGE(TAG, "NVS Invalid Handle");
+            break;
+        case ESP_ERR_NVS_INVALID_NAME:
+            ESP_LOGE(TAG, "NVS Invalid Name");
+            break;
+        case ESP_ERR_NVS_INVALID_LENGTH:
+            ESP_LOGE(TAG, "NVS Invalid Length");
+            break;
+        default:
+            ESP_LOGE(TAG, "WTFBBQ!");
+            break;
+    }
+
+    return found;
+}
+
+void nir_nvs_write_blob(const char* key, const void* value, const size_t len) {
+    ESP_LOGI(TAG, "nvs_set_blob");
+    switch (nvs_set_blob(_nir_nvs_handle, key, value, len)) {
+        case ESP_OK:
+            ESP_LOGI(TAG, "NVS OK");
+            break;
+        case ESP_ERR_NVS_INVALID_HANDLE:
+            ESP_LOGE(TAG, "NVS Invalid Handle");
+            break;
+        case ESP_ERR_NVS_READ_ONLY:
+            ESP_LOGE(TAG, "NVS Read Only");
+            break;
+        case ESP_ERR_NVS_INVALID_NAME:
+            ESP_LOGE(TAG, "NVS Invalid Name");
+            break;
+        case ESP_ERR_NVS_NOT_ENOUGH_SPACE:
+            ESP_LOGE(TAG, "NVS Not Enough Space");
+            break;
+        case ESP_ERR_NVS_REMOVE_FAILED:
+            ESP_LOGE(TAG, "NVS Remove Failed");
+            break;
+        default:
+            ESP_LOGE(TAG, "WTFBBQ!");
+            break;
+    }
+
+    ESP_LOGI(TAG, "nvs_commit");
+    _nir_nvs_commits++;
     switch (nvs_commit(_nir_nvs_handle)) {
         case ESP_OK:
             ESP_LOGI(TAG, "NVS OK");
@@ -206,3 +355,75 @@ void nir_nvs_write_uint16(const char* key, const uint16_t value) {
             break;
     }
 }
+
+size_t nir_nvs_read_blob_len(const char* key, void* value, const size_t max_len) {
+    size_t len = max_len;
+
+    ESP_LOGI(TAG, "nvs_get_blob");
+    switch (nvs_get_blob(_nir_nvs_handle, key, value, &len)) {
+        case ESP_OK:
+            ESP_LOGI(TAG, "NVS OK");
+            break;
+        case ESP_ERR_NVS_NOT_FOUND:
+            ESP_LOGW(TAG, "NVS Not Found");
+            len = 0;
+            break;
+        case ESP_ERR_NVS_INVALID_HANDLE:
+            ESP_LOGE(TAG, "NVS Invalid Handle");
+            len = 0;
+            break;
+        case ESP_ERR_NVS_INVALID_NAME:
+            ESP_LOGE(TAG, "NVS Invalid Name");
+            len = 0;
+            break;
+        case ESP_ERR_NVS_INVALID_LENGTH:
+            ESP_LOGE(TAG, "NVS Invalid Length");
+            len = 0;
+            break;
+        default:
+            ESP_LOGE(TAG, "WTFBBQ!");
+            len = 0;
+            break;
+    }
+
+    return len;
+}
+
+void nir_nvs_erase(const char* key) {
+    ESP_LOGI(TAG, "nvs_erase_key");
+    switch (nvs_erase_key(_nir_nvs_handle, key)) {
+        case ESP_OK:
+            ESP_LOGI(TAG, "NVS OK");
+            break;
+        case ESP_ERR_NVS_NOT_FOUND:
+            ESP_LOGW(TAG, "NVS Not Found");
+            break;
+        case ESP_ERR_NVS_INVALID_HANDLE:
+            ESP_LOGE(TAG, "NVS Invalid Handle");
+            break;
+        case ESP_ERR_NVS_READ_ONLY:
+            ESP_LOGE(TAG, "NVS Read Only");
+            break;
+        default:
+            ESP_LOGE(TAG, "WTFBBQ!");
+            break;
+    }
+
+    ESP_LOGI(TAG, "nvs_commit");
+    _nir_nvs_commits++;
+    switch (nvs_commit(_nir_nvs_handle)) {
+        case ESP_OK:
+            ESP_LOGI(TAG, "NVS OK");
+            break;
+        case ESP_ERR_NVS_INVALID_HANDLE:
+            ESP_LOGE(TAG, "NVS Invalid Handle");
+            break;
+        default:
+            ESP_LOGE(TAG, "WTFBBQ!");
+            break;
+    }
+}
+
+uint32_t nir_nvs_get_commits(void) {
+    return _nir_nvs_commits;
+}
@@ -1,3 +1,5 @@
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #ifndef NIR_NVS_H
@@ -12,4 +14,15 @@ void nir_nvs_write_bool(const char* key, const bool value);
 uint16_t nir_nvs_read_uint16(const char* key, const uint16_t default_value);
 void nir_nvs_write_uint16(const char* key, const uint16_t value);
 
+uint32_t nir_nvs_read_uint32(const char* key, const uint32_t default_value);
+void nir_nvs_write_uint32(const char* key, const uint32_t value);
+
+bool nir_nvs_read_blob(const char* key, void* value, const size_t len);
+void nir_nvs_write_blob(const char* key, const void* value, const size_t len);
+size_t nir_nvs_read_blob_len(const char* key, void* value, const size_t max_len);
+
+void nir_nvs_erase(const char* key);
+
+uint32_t nir_nvs_get_commits(void);
+
 #endif // NIR_NVS_H
@@ -0,0 +1,172 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sdkconfig.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+
+#include "nir_pm.h"
+
+// NOTE: https://docs.espressif.com/projects/esp-idf/en/v4.4/esp32s3/api-reference/system/power_management.html
+
+static esp_pm_lock_handle_t _nir_pm_sleep_lock;
+
+/// the frame callbacks on the esp_timer task and nir_timer_stop on the BLE
+/// host or serial task both release, the check and the lock change are one step
+static portMUX_TYPE _nir_pm_held_lock = portMUX_INITIALIZER_UNLOCKED;
+static volatile bool _nir_pm_held = false;
+
+#ifdef CONFIG_PM_PROFILING
+static volatile int64_t _nir_pm_held_since = 0;
+static volatile int64_t _nir_pm_held_us = 0;
+static volatile uint32_t _nir_pm_held_count = 0;
+
+/// esp_pm_dump_locks only reports totals since boot, intervals are the difference
+static char _nir_pm_dump_buffer[NIR_PM_DUMP_MAX];
+static FILE* _nir_pm_dump;
+static nir_pm_stats_t _nir_pm_last;
+
+static esp_timer_handle_t _nir_pm_profiling_timer;
+
+static void _nir_pm_profile(void* arg);
+
+static esp_timer_create_args_t _nir_pm_profiling_timer_args = {
+    .name = "pm_profiling_timer",
+    .callback = _nir_pm_profile
+};
+#endif
+
+void nir_pm_init(void) {
+    ESP_LOGI(TAG, "nir_pm_init");
+
+    esp_pm_config_esp32s3_t pm_config = {
+        .max_freq_mhz = CONFIG_ESP32S3_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = NIR_PM_MIN_FREQ_MHZ,
+        .light_sleep_enable = true
+    };
+
+    ESP_LOGI(TAG, "esp_pm_configure max: %d min: %d", pm_config.max_freq_mhz, pm_config.min_freq_mhz);
+    ESP_ERROR_CHECK(esp_pm_configure(&pm_config));
+
+    // the RMT runs from XTAL, which DFS leaves alone, but light sleep gates
+    // it, so a shot keeps the chip awake until the final mark is clocked out
+    ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "nir_ir_sleep", &_nir_pm_sleep_lock));
+
+#ifdef CONFIG_PM_PROFILING
+    // opened once, the dump is rewritten in place every interval without allocating
+    _nir_pm_dump = fmemopen(_nir_pm_dump_buffer, sizeof _nir_pm_dump_buffer, "w");
+    if (!_nir_pm_dump) {
+        ESP_LOGE(TAG, "nir_pm_init: fmemopen failed");
+    }
+
+    ESP_ERROR_CHECK(esp_timer_create(&_nir_pm_profiling_timer_args, &_nir_pm_profiling_timer));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(_nir_pm_profiling_timer, NIR_PM_PROFILING_INTERVAL_US));
+#endif
+}
+
+void nir_pm_acquire(void) {
+    portENTER_CRITICAL(&_nir_pm_held_lock);
+    if (_nir_pm_held) {
+        portEXIT_CRITICAL(&_nir_pm_held_lock);
+        return; // already holding
+    }
+
+    esp_pm_lock_acquire(_nir_pm_sleep_lock);
+    _nir_pm_held = true;
+
+#ifdef CONFIG_PM_PROFILING
+    _nir_pm_held_since = esp_timer_get_time();
+    _nir_pm_held_count++;
+#endif
+    portEXIT_CRITICAL(&_nir_pm_held_lock);
+}
+
+void nir_pm_release(void) {
+    portENTER_CRITICAL(&_nir_pm_held_lock);
+    if (!_nir_pm_held) {
+        portEXIT_CRITICAL(&_nir_pm_held_lock);
+        return; // nothing to do
+    }
+
+#ifdef CONFIG_PM_PROFILING
+    _nir_pm_held_us += esp_timer_get_time() - _nir_pm_held_since;
+#endif
+
+    _nir_pm_held = false;
+    esp_pm_lock_release(_nir_pm_sleep_lock);
+    portEXIT_CRITICAL(&_nir_pm_held_lock);
+}
+
+// The "Mode stats" table of esp_pm_dump_locks, one
+// "<mode> <freq> M <time us> <percent>%" line per mode, the M follows the
+// frequency padded to 3 columns. Modes that are not reported, e.g. SLEEP
+// without light sleep, stay 0.
+bool nir_pm_parse_stats(const char* dump, nir_pm_stats_t* stats) {
+    static const char* names[NIR_PM_MODES] = { "SLEEP", "APB_MIN", "APB_MAX", "CPU_MAX" };
+
+    memset(stats, 0, sizeof *stats);
+
+    const char* line = strstr(dump, "Mode stats:");
+    if (!line) {
+        return false;
+    }
+
+    bool found = false;
+
+    while ((line = strchr(line, '\n')) && *++line) {
+        char name[16];
+        int freq_mhz;
+        long long time_us;
+
+        if (sscanf(line, "%15s %d %*[M] %lld", name, &freq_mhz, &time_us) != 3) {
+            continue; // column headings
+        }
+
+        for (int mode = 0; mode < NIR_PM_MODES; mode++) {
+            if (strcmp(name, names[mode]) == 0) {
+                stats->mode_us[mode] = time_us;
+                found = true;
+            }
+        }
+    }
+
+    return found;
+}
+
+#ifdef CONFIG_PM_PROFILING
+static void _nir_pm_profile(void* arg) {
+    int64_t held_us = _nir_pm_held_us;
+    uint32_t held_count = _nir_pm_held_count;
+
+    _nir_pm_held_us = 0;
+    _nir_pm_held_count = 0;
+
+    ESP_LOGI(TAG, "nir_pm interval: %d us, ir bursts: %u, ir lock held: %" PRId64 " us",
+        NIR_PM_PROFILING_INTERVAL_US, held_count, held_us);
+
+    if (!_nir_pm_dump) {
+        return;
+    }
+
+    rewind(_nir_pm_dump);
+    esp_pm_dump_locks(_nir_pm_dump);
+    fputc('\0', _nir_pm_dump);
+    fflush(_nir_pm_dump);
+
+    nir_pm_stats_t stats;
+    if (!nir_pm_parse_stats(_nir_pm_dump_buffer, &stats)) {
+        ESP_LOGW(TAG, "nir_pm: no mode stats in esp_pm_dump_locks");
+        return;
+    }
+
+    // time in each mode during this interval rather than since boot
+    ESP_LOGI(TAG, "nir_pm interval sleep: %" PRId64 " us, apb_min: %" PRId64 " us, apb_max: %" PRId64 " us, "
+        "cpu_max: %" PRId64 " us",
+        stats.mode_us[NIR_PM_MODE_SLEEP] - _nir_pm_last.mode_us[NIR_PM_MODE_SLEEP],
+        stats.mode_us[NIR_PM_MODE_APB_MIN] - _nir_pm_last.mode_us[NIR_PM_MODE_APB_MIN],
+        stats.mode_us[NIR_PM_MODE_APB_MAX] - _nir_pm_last.mode_us[NIR_PM_MODE_APB_MAX],
+        stats.mode_us[NIR_PM_MODE_CPU_MAX] - _nir_pm_last.mode_us[NIR_PM_MODE_CPU_MAX]);
+
+    _nir_pm_last = stats;
+}
+#endif
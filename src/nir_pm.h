@@ -0,0 +1,43 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <esp_pm.h>
+#include <esp_log.h>
+
+#include "nikon_ir_remote.h"
+
+#ifndef NIR_PM_H
+#define NIR_PM_H
+
+/// XTAL frequency, lowest frequency DFS is allowed to drop to
+#define NIR_PM_MIN_FREQ_MHZ (40)
+
+/// 60 seconds, interval between frequency level reports when CONFIG_PM_PROFILING is set
+#define NIR_PM_PROFILING_INTERVAL_US (60000000)
+
+/// esp_pm_dump_locks output kept for parsing, lock and mode tables
+#define NIR_PM_DUMP_MAX (2048)
+
+/// modes in the order esp_pm_dump_locks reports them
+typedef enum {
+    NIR_PM_MODE_SLEEP,
+    NIR_PM_MODE_APB_MIN,
+    NIR_PM_MODE_APB_MAX,
+    NIR_PM_MODE_CPU_MAX,
+    NIR_PM_MODES,
+} nir_pm_mode_t;
+
+/// microseconds spent in each mode since boot
+typedef struct {
+    int64_t mode_us[NIR_PM_MODES];
+} nir_pm_stats_t;
+
+extern const char *TAG;
+
+void nir_pm_init(void);
+
+void nir_pm_acquire(void);
+void nir_pm_release(void);
+
+bool nir_pm_parse_stats(const char* dump, nir_pm_stats_t* stats);
+
+#endif // NIR_PM_H
@@ -0,0 +1,68 @@
+#include <string.h>
+#include <esp_log.h>
+
+#include "nir_preset.h"
+
+#include "nir_nvs.h"
+
+extern const char *TAG;
+
+/// all presets in a single blob, one NVS entry regardless of count
+static const char* _nir_presets_key = "nir_presets";
+
+static nir_preset_t _nir_presets[NIR_PRESETS_MAX] = { {
+        .name = "sunset",
+        .delayms = 2000,
+        .carrierhz = 38000,
+        .protocol = 0,
+        .duty = 33,
+    }, {
+        .name = "night",
+        .delayms = 30000,
+        .carrierhz = 38000,
+        .protocol = 0,
+        .duty = 33,
+    }, {
+        .name = "fast",
+        .delayms = 100,
+        .carrierhz = 38000,
+        .protocol = 0,
+        .duty = 33,
+    }, {
+        .name = "daylight",
+        .delayms = 10000,
+        .carrierhz = 38000,
+        .protocol = 0,
+        .duty = 33,
+    }
+};
+
+void nir_presets_load(void) {
+    ESP_LOGI(TAG, "nir_presets_load");
+
+    nir_preset_t presets[NIR_PRESETS_MAX];
+
+    // keep the defaults until a preset has been saved
+    if (nir_nvs_read_blob(_nir_presets_key, presets, sizeof presets)) {
+        memcpy(_nir_presets, presets, sizeof _nir_presets);
+    }
+}
+
+const nir_preset_t* nir_preset_get(uint16_t preset) {
+    if (preset == NIR_PRESET_NONE || preset > NIR_PRESETS_MAX) {
+        return NULL;
+    }
+
+    return &_nir_presets[preset - 1];
+}
+
+void nir_preset_save(uint16_t preset, const nir_preset_t* value) {
+    if (preset == NIR_PRESET_NONE || preset > NIR_PRESETS_MAX) {
+        return;
+    }
+
+    ESP_LOGI(TAG, "nir_preset_save %u: %.*s", preset, NIR_PRESET_NAME_LEN, value->name);
+
+    _nir_presets[preset - 1] = *value;
+    nir_nvs_write_blob(_nir_presets_key, _nir_presets, sizeof _nir_presets);
+}
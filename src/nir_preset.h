@@ -0,0 +1,29 @@
+#include <stdint.h>
+
+#include "nikon_ir_remote.h"
+
+#ifndef NIR_PRESET_H
+#define NIR_PRESET_H
+
+/// presets are numbered 1 to NIR_PRESETS_MAX, 0 is no preset active
+#define NIR_PRESETS_MAX (4)
+#define NIR_PRESET_NONE (0)
+
+#define NIR_PRESET_NAME_LEN (12)
+
+#define NIR_PRESET_NVS_KEY "nir_preset"
+
+typedef struct __attribute__((packed)) {
+    char name[NIR_PRESET_NAME_LEN];
+    uint16_t delayms;
+    uint16_t carrierhz;
+    uint8_t protocol;
+    uint8_t duty;
+} nir_preset_t;
+
+void nir_presets_load(void);
+
+const nir_preset_t* nir_preset_get(uint16_t preset);
+void nir_preset_save(uint16_t preset, const nir_preset_t* value);
+
+#endif // NIR_PRESET_H
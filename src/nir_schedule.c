@@ -0,0 +1,226 @@
+#include <inttypes.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <esp_attr.h>
+#include <esp_log.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+
+#include "nir_schedule.h"
+
+#include "nir_ble.h"
+
+static uint32_t _nir_schedule_start = 0;
+static uint32_t _nir_schedule_stop = 0;
+static bool _nir_schedule_repeat = false;
+
+static bool _nir_schedule_open = true;
+/// the next open or close on the esp_timer clock, 0 for none
+static int64_t _nir_schedule_next = 0;
+/// a boundary passed, handled by the control task
+static volatile bool _nir_schedule_pending = false;
+
+// The system time is kept by the RTC across software resets, e.g. a panic or
+// watchdog reboot, so windows keep running without the central reconnecting.
+static RTC_NOINIT_ATTR uint32_t _nir_schedule_synced;
+
+static esp_timer_handle_t _nir_schedule_timer;
+
+static void _nir_schedule_boundary(void* arg);
+
+static esp_timer_create_args_t _nir_schedule_timer_args = {
+    .name = "schedule_timer",
+    .callback = _nir_schedule_boundary
+};
+
+static int64_t _nir_schedule_now_us(void) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+
+    return (int64_t) now.tv_sec * 1000000 + now.tv_usec;
+}
+
+// The window around or after nowus, false when shooting is not restricted.
+// A daily window that has closed moves to the next day it has not closed on.
+static bool _nir_schedule_window(int64_t nowus, int64_t* openus, int64_t* closeus) {
+    if (_nir_schedule_synced != NIR_SCHEDULE_SYNCED_MAGIC || !_nir_schedule_start) {
+        return false;
+    }
+
+    if (_nir_schedule_stop <= _nir_schedule_start) {
+        ESP_LOGW(TAG, "nir_schedule: stop %u not after start %u, ignoring", _nir_schedule_stop, _nir_schedule_start);
+        return false;
+    }
+
+    int64_t open = (int64_t) _nir_schedule_start * 1000000;
+    int64_t close = (int64_t) _nir_schedule_stop * 1000000;
+
+    if (_nir_schedule_repeat && nowus >= close) {
+        int64_t days = (nowus - open) / NIR_SCHEDULE_DAY_US;
+        open += days * NIR_SCHEDULE_DAY_US;
+        close += days * NIR_SCHEDULE_DAY_US;
+
+        if (nowus >= close) {
+            open += NIR_SCHEDULE_DAY_US;
+            close += NIR_SCHEDULE_DAY_US;
+        }
+    }
+
+    *openus = open;
+    *closeus = close;
+
+    return true;
+}
+
+// Arm the boundary timer for the next open or close. Outside a window the IR
+// path is stopped by nir_reschedule and advertising slows down. True when the
+// shots need rescheduling: the window opened or closed, or the opening they
+// are waiting for moved.
+static bool _nir_schedule_arm(void) {
+    int64_t nowus = _nir_schedule_now_us();
+    int64_t openus;
+    int64_t closeus;
+    int64_t inus = 0;
+
+    bool open = _nir_schedule_open;
+    int64_t next = _nir_schedule_next;
+
+    esp_timer_stop(_nir_schedule_timer);
+
+    if (!_nir_schedule_window(nowus, &openus, &closeus)) {
+        _nir_schedule_open = true;
+    } else if (nowus >= closeus) {
+        ESP_LOGI(TAG, "nir_schedule: last window has closed");
+        _nir_schedule_open = false;
+    } else if (nowus < openus) {
+        ESP_LOGI(TAG, "nir_schedule: opens in %" PRId64 " us", openus - nowus);
+        _nir_schedule_open = false;
+        inus = openus - nowus;
+    } else {
+        ESP_LOGI(TAG, "nir_schedule: closes in %" PRId64 " us", closeus - nowus);
+        _nir_schedule_open = true;
+        inus = closeus - nowus;
+    }
+
+    if (inus) {
+        esp_timer_start_once(_nir_schedule_timer, inus);
+        _nir_schedule_next = esp_timer_get_time() + inus;
+    } else {
+        _nir_schedule_next = 0;
+    }
+
+    nir_ble_set_adv_slow(!_nir_schedule_open);
+
+    // shots run free inside a window, its close only needs the timer armed
+    return open != _nir_schedule_open
+        || (!_nir_schedule_open && llabs(_nir_schedule_next - next) > NIR_SCHEDULE_SLACK_US);
+}
+
+// esp_timer task, the window state belongs to the settings lock holder
+static void _nir_schedule_boundary(void* arg) {
+    _nir_schedule_pending = true;
+    nir_control_notify();
+}
+
+static void _nir_schedule_changed(void) {
+    if (_nir_schedule_arm()) {
+        nir_reschedule();
+    }
+}
+
+void nir_schedule_service(void) {
+    if (!_nir_schedule_pending) {
+        return;
+    }
+
+    _nir_schedule_pending = false;
+
+    // the timer was armed to shoot on the opening, only a close needs it stopped
+    if (_nir_schedule_arm() && !_nir_schedule_open) {
+        nir_reschedule();
+    }
+}
+
+void nir_schedule_init(void) {
+    ESP_LOGI(TAG, "nir_schedule_init");
+
+    // RTC_NOINIT memory and the system time are both undefined after power on
+    if (esp_reset_reason() == ESP_RST_POWERON) {
+        _nir_schedule_synced = 0;
+    }
+
+    ESP_ERROR_CHECK(esp_timer_create(&_nir_schedule_timer_args, &_nir_schedule_timer));
+}
+
+uint32_t nir_schedule_get_time(void) {
+    if (_nir_schedule_synced != NIR_SCHEDULE_SYNCED_MAGIC) {
+        return 0;
+    }
+
+    return _nir_schedule_now_us() / 1000000;
+}
+
+void nir_schedule_set_time(uint32_t seconds) {
+    ESP_LOGI(TAG, "nir_schedule_set_time: %u", seconds);
+
+    struct timeval now = {
+        .tv_sec = seconds,
+        .tv_usec = 0,
+    };
+
+    settimeofday(&now, NULL);
+    _nir_schedule_synced = NIR_SCHEDULE_SYNCED_MAGIC;
+
+    _nir_schedule_changed();
+}
+
+uint32_t nir_schedule_get_start(void) {
+    return _nir_schedule_start;
+}
+
+void nir_schedule_set_start(uint32_t seconds) {
+    ESP_LOGI(TAG, "nir_schedule_set_start(%u): %u", _nir_schedule_start, seconds);
+
+    _nir_schedule_start = seconds;
+    _nir_schedule_changed();
+}
+
+uint32_t nir_schedule_get_stop(void) {
+    return _nir_schedule_stop;
+}
+
+void nir_schedule_set_stop(uint32_t seconds) {
+    ESP_LOGI(TAG, "nir_schedule_set_stop(%u): %u", _nir_schedule_stop, seconds);
+
+    _nir_schedule_stop = seconds;
+    _nir_schedule_changed();
+}
+
+uint32_t nir_schedule_get_repeat(void) {
+    return _nir_schedule_repeat;
+}
+
+void nir_schedule_set_repeat(uint32_t repeat) {
+    ESP_LOGI(TAG, "nir_schedule_set_repeat(%d): %u", _nir_schedule_repeat, repeat);
+
+    _nir_schedule_repeat = repeat;
+    _nir_schedule_changed();
+}
+
+// 0 when shooting is allowed now, otherwise microseconds until the next
+// window opens or NIR_SCHEDULE_NEVER.
+int64_t nir_schedule_open_in_us(void) {
+    int64_t nowus = _nir_schedule_now_us();
+    int64_t openus;
+    int64_t closeus;
+
+    if (!_nir_schedule_window(nowus, &openus, &closeus)) {
+        return 0;
+    }
+
+    if (nowus >= closeus) {
+        return NIR_SCHEDULE_NEVER;
+    }
+
+    return nowus >= openus ? 0 : openus - nowus;
+}
@@ -0,0 +1,46 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "nikon_ir_remote.h"
+
+#ifndef NIR_SCHEDULE_H
+#define NIR_SCHEDULE_H
+
+#define NIR_SCHEDULE_DAY_US (86400LL * 1000000)
+
+/// nir_schedule_open_in_us once a one off window has passed
+#define NIR_SCHEDULE_NEVER (-1)
+
+/// the opening shots wait for is only moved by more than this, the time
+/// characteristic has a resolution of a second
+#define NIR_SCHEDULE_SLACK_US (1000000)
+
+/// marks the system time as set by the central, survives software resets
+#define NIR_SCHEDULE_SYNCED_MAGIC (0x4E495254)
+
+extern const char *TAG;
+
+void nir_schedule_init(void);
+
+// Wall clock seconds since 1970 as the central sees it. Windows are compared
+// against the same clock, so local time works as long as it is used for both.
+uint32_t nir_schedule_get_time(void);
+void nir_schedule_set_time(uint32_t seconds);
+
+/// window open and close, seconds since 1970, start 0 for no window
+uint32_t nir_schedule_get_start(void);
+void nir_schedule_set_start(uint32_t seconds);
+uint32_t nir_schedule_get_stop(void);
+void nir_schedule_set_stop(uint32_t seconds);
+
+/// repeat the window every 24 hours
+uint32_t nir_schedule_get_repeat(void);
+void nir_schedule_set_repeat(uint32_t repeat);
+
+int64_t nir_schedule_open_in_us(void);
+
+// Handles a window opening or closing, called by the control task with the
+// settings locked.
+void nir_schedule_service(void);
+
+#endif // NIR_SCHEDULE_H
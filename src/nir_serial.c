@@ -0,0 +1,212 @@
+#include <string.h>
+#include <esp_log.h>
+#include <esp_pm.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "nir_serial.h"
+
+#include "nir_settings.h"
+
+typedef enum {
+    NIR_SERIAL_WAIT_SYNC,
+    NIR_SERIAL_WAIT_LENGTH,
+    NIR_SERIAL_WAIT_BODY,
+} _nir_serial_state_t;
+
+/// length, opcode, sequence, payload and crc
+static uint8_t _nir_serial_frame[1 + 2 + NIR_SERIAL_MAX_PAYLOAD + 2];
+static uint8_t _nir_serial_received = 0;
+static _nir_serial_state_t _nir_serial_state = NIR_SERIAL_WAIT_SYNC;
+
+static uint32_t _nir_serial_crc_errors = 0;
+
+static StaticTask_t _nir_serial_task_buffer;
+static StackType_t _nir_serial_task_stack[NIR_SERIAL_TASK_STACK];
+
+static esp_pm_lock_handle_t _nir_serial_pm_lock;
+
+static void _nir_serial_task(void* param);
+
+void nir_serial_init(void) {
+    ESP_LOGI(TAG, "nir_serial_init uart: %d baud: %d", NIR_SERIAL_UART, NIR_SERIAL_BAUD);
+
+    uart_config_t config = {
+        .baud_rate = NIR_SERIAL_BAUD,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+        .source_clk = UART_SCLK_XTAL, // keeps the baud rate while DFS scales APB
+    };
+
+    ESP_ERROR_CHECK(uart_driver_install(NIR_SERIAL_UART, NIR_SERIAL_BUFFER, NIR_SERIAL_BUFFER, 0, NULL, 0));
+    ESP_ERROR_CHECK(uart_param_config(NIR_SERIAL_UART, &config));
+    ESP_ERROR_CHECK(uart_set_pin(NIR_SERIAL_UART, NIR_SERIAL_TX_PIN, NIR_SERIAL_RX_PIN, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
+
+    ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "nir_serial", &_nir_serial_pm_lock));
+    esp_pm_lock_acquire(_nir_serial_pm_lock);
+
+    xTaskCreateStatic(_nir_serial_task, "nir_serial", NIR_SERIAL_TASK_STACK, NULL, 5,
+        _nir_serial_task_stack, &_nir_serial_task_buffer);
+}
+
+uint16_t nir_serial_crc16(const uint8_t* data, uint16_t len) {
+    uint16_t crc = 0xFFFF;
+
+    for (uint16_t i = 0; i < len; i++) {
+        crc ^= (uint16_t) data[i] << 8;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+
+    return crc;
+}
+
+static void _nir_serial_reply(uint8_t opcode, uint8_t sequence, uint8_t status, const uint8_t* payload, uint8_t len) {
+    uint8_t reply[5 + NIR_SERIAL_MAX_PAYLOAD + 2];
+    uint8_t length = 3 + len; // opcode, sequence, status, payload
+
+    reply[0] = NIR_SERIAL_SYNC;
+    reply[1] = length;
+    reply[2] = opcode | NIR_SERIAL_REPLY;
+    reply[3] = sequence;
+    reply[4] = status;
+    memcpy(&reply[5], payload, len);
+
+    uint16_t crc = nir_serial_crc16(&reply[1], 1 + length);
+    reply[2 + length] = crc & 0xFF;
+    reply[3 + length] = crc >> 8;
+
+    uart_write_bytes(NIR_SERIAL_UART, reply, 4 + length);
+}
+
+static uint8_t _nir_serial_status(nir_setting_result_t result) {
+    switch (result) {
+        case NIR_SETTING_OK:
+            return NIR_SERIAL_OK;
+        case NIR_SETTING_INVALID_LENGTH:
+            return NIR_SERIAL_BAD_LENGTH;
+        case NIR_SETTING_OUT_OF_RANGE:
+            return NIR_SERIAL_OUT_OF_RANGE;
+        case NIR_SETTING_READ_ONLY:
+            return NIR_SERIAL_READ_ONLY;
+    }
+
+    return NIR_SERIAL_BAD_OPCODE;
+}
+
+// Settings are addressed by their row in nir_settings, the same order as the
+// characteristics of the GATT service.
+static void _nir_serial_dispatch(uint8_t opcode, uint8_t sequence, const uint8_t* payload, uint8_t len) {
+    uint8_t value[sizeof (uint32_t)];
+
+    switch (opcode) {
+        case NIR_SERIAL_OP_COUNT:
+            value[0] = nir_settings_count;
+            _nir_serial_reply(opcode, sequence, NIR_SERIAL_OK, value, 1);
+            break;
+
+        case NIR_SERIAL_OP_READ:
+            if (len != 1 || payload[0] >= nir_settings_count) {
+                _nir_serial_reply(opcode, sequence, NIR_SERIAL_BAD_SETTING, NULL, 0);
+                break;
+            }
+
+            _nir_serial_reply(opcode, sequence, NIR_SERIAL_OK, value, nir_setting_read(&nir_settings[payload[0]], value));
+            break;
+
+        case NIR_SERIAL_OP_WRITE:
+            if (len < 1 || payload[0] >= nir_settings_count) {
+                _nir_serial_reply(opcode, sequence, NIR_SERIAL_BAD_SETTING, NULL, 0);
+                break;
+            }
+
+            _nir_serial_reply(opcode, sequence,
+                _nir_serial_status(nir_setting_write(&nir_settings[payload[0]], &payload[1], len - 1)), NULL, 0);
+            break;
+
+        case NIR_SERIAL_OP_ECHO:
+            // the status byte takes one from the payload a reply can carry
+            if (len > NIR_SERIAL_MAX_PAYLOAD - 1) {
+                _nir_serial_reply(opcode, sequence, NIR_SERIAL_BAD_LENGTH, NULL, 0);
+                break;
+            }
+
+            _nir_serial_reply(opcode, sequence, NIR_SERIAL_OK, payload, len);
+            break;
+
+        default:
+            _nir_serial_reply(opcode, sequence, NIR_SERIAL_BAD_OPCODE, NULL, 0);
+            break;
+    }
+}
+
+static void _nir_serial_receive(uint8_t byte) {
+    switch (_nir_serial_state) {
+        case NIR_SERIAL_WAIT_SYNC:
+            if (byte == NIR_SERIAL_SYNC) {
+                _nir_serial_state = NIR_SERIAL_WAIT_LENGTH;
+            }
+            break;
+
+        case NIR_SERIAL_WAIT_LENGTH:
+            if (byte < 2 || byte > 2 + NIR_SERIAL_MAX_PAYLOAD) {
+                _nir_serial_state = NIR_SERIAL_WAIT_SYNC; // resynchronise
+                break;
+            }
+
+            _nir_serial_frame[0] = byte;
+            _nir_serial_received = 1;
+            _nir_serial_state = NIR_SERIAL_WAIT_BODY;
+            break;
+
+        case NIR_SERIAL_WAIT_BODY: {
+            uint8_t length = _nir_serial_frame[0];
+
+            _nir_serial_frame[_nir_serial_received++] = byte;
+            if (_nir_serial_received < 1 + length + 2) {
+                break;
+            }
+
+            _nir_serial_state = NIR_SERIAL_WAIT_SYNC;
+
+            uint16_t crc = nir_serial_crc16(_nir_serial_frame, 1 + length);
+            uint16_t received = _nir_serial_frame[1 + length] | (_nir_serial_frame[2 + length] << 8);
+            if (crc != received) {
+                _nir_serial_crc_errors++;
+                ESP_LOGW(TAG, "nir_serial crc: %04x, expected: %04x, errors: %u", received, crc, _nir_serial_crc_errors);
+                break;
+            }
+
+            _nir_serial_dispatch(_nir_serial_frame[1], _nir_serial_frame[2], &_nir_serial_frame[3], length - 2);
+            break;
+        }
+    }
+}
+
+static void _nir_serial_task(void* param) {
+    uint8_t buffer[64];
+
+    for (;;) {
+        // sleep until a request starts arriving, then take whatever is buffered
+        // without waiting, so a short request is not held until the buffer fills
+        if (uart_read_bytes(NIR_SERIAL_UART, buffer, 1, portMAX_DELAY) != 1) {
+            continue;
+        }
+        _nir_serial_receive(buffer[0]);
+
+        size_t buffered = 0;
+        while (uart_get_buffered_data_len(NIR_SERIAL_UART, &buffered) == ESP_OK && buffered) {
+            int len = uart_read_bytes(NIR_SERIAL_UART, buffer, buffered < sizeof buffer ? buffered : sizeof buffer, 0);
+            if (len <= 0) {
+                break;
+            }
+
+            for (int i = 0; i < len; i++) {
+                _nir_serial_receive(buffer[i]);
+            }
+        }
+    }
+}
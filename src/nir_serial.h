@@ -0,0 +1,57 @@
+#include <stdint.h>
+#include <driver/uart.h>
+
+#include "nikon_ir_remote.h"
+
+#ifndef NIR_SERIAL_H
+#define NIR_SERIAL_H
+
+// Define NIR_SERIAL for wired control on bench and studio rigs. The UART
+// cannot receive during light sleep, so light sleep is held off while enabled.
+// #define NIR_SERIAL
+
+/// UART0 is the console, control uses UART1
+#define NIR_SERIAL_UART (UART_NUM_1)
+#define NIR_SERIAL_TX_PIN (17)
+#define NIR_SERIAL_RX_PIN (18)
+#define NIR_SERIAL_BAUD (921600)
+
+#define NIR_SERIAL_BUFFER (1024)
+#define NIR_SERIAL_TASK_STACK (3072)
+
+// Frame: sync, length, opcode, sequence, payload, crc16
+//
+//   0xA5 | len (opcode + sequence + payload) | opcode | seq | payload... | crc lo | crc hi
+//
+// The CRC is CRC-16/CCITT-FALSE over length through payload. Replies echo the
+// sequence number with the opcode's high bit set and a status byte as the
+// first payload byte, so a host can pipeline requests and match replies.
+#define NIR_SERIAL_SYNC (0xA5)
+#define NIR_SERIAL_MAX_PAYLOAD (32)
+
+/// payload: none, reply: setting count
+#define NIR_SERIAL_OP_COUNT (0x01)
+/// payload: setting index, reply: value
+#define NIR_SERIAL_OP_READ (0x02)
+/// payload: setting index, value, reply: none
+#define NIR_SERIAL_OP_WRITE (0x03)
+/// payload: up to NIR_SERIAL_MAX_PAYLOAD - 1 bytes, reply: same payload after the status
+#define NIR_SERIAL_OP_ECHO (0x04)
+
+#define NIR_SERIAL_REPLY (0x80)
+
+/// reply status
+#define NIR_SERIAL_OK (0x00)
+#define NIR_SERIAL_BAD_OPCODE (0x01)
+#define NIR_SERIAL_BAD_SETTING (0x02)
+#define NIR_SERIAL_BAD_LENGTH (0x03)
+#define NIR_SERIAL_OUT_OF_RANGE (0x04)
+#define NIR_SERIAL_READ_ONLY (0x05)
+
+extern const char *TAG;
+
+void nir_serial_init(void);
+
+uint16_t nir_serial_crc16(const uint8_t* data, uint16_t len);
+
+#endif // NIR_SERIAL_H
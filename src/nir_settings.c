@@ -0,0 +1,550 @@
+#include <string.h>
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "nir_settings.h"
+
+#include "nir_ble.h"
+#include "nir_code.h"
+#include "nir_learn.h"
+#include "nir_mem.h"
+#include "nir_nvs.h"
+#include "nir_preset.h"
+#include "nir_schedule.h"
+#include "nir_trace.h"
+
+extern const char *TAG;
+
+static uint32_t _nir_get_enabled(void);
+static void _nir_set_enabled(uint32_t value);
+static uint32_t _nir_get_delayms(void);
+static void _nir_set_delayms(uint32_t value);
+static uint32_t _nir_get_burst(void);
+static void _nir_set_burst(uint32_t value);
+static uint32_t _nir_get_bulbms(void);
+static void _nir_set_bulbms(uint32_t value);
+static uint32_t _nir_get_carrierhz(void);
+static void _nir_set_carrierhz(uint32_t value);
+static uint32_t _nir_get_duty(void);
+static void _nir_set_duty(uint32_t value);
+static uint32_t _nir_get_protocol(void);
+static void _nir_set_protocol(uint32_t value);
+static bool _nir_valid_protocol(uint32_t value);
+static uint32_t _nir_get_preset(void);
+static void _nir_set_preset(uint32_t value);
+static uint32_t _nir_get_presetsave(void);
+static void _nir_set_presetsave(uint32_t value);
+static uint32_t _nir_get_learn(void);
+static void _nir_set_learn(uint32_t value);
+
+// Every characteristic of the Nikon IR Remote service, one row per setting.
+// The row index is also the characteristic order in the GATT service.
+const nir_setting_t nir_settings[] = { {
+        .name = "enabled",
+        .uuid = {
+            .u = { .type = BLE_UUID_TYPE_128 },
+            .value = { 0xFF, 0xEE, 0xDD, 0xCC, 0xBB, 0xAA, 0x99, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0x01 },
+        },
+        .type = NIR_SETTING_BOOL,
+        .min = 0,
+        .max = 1,
+        .default_value = false,
+        .nvs_key = "nir_enabled",
+        .get = _nir_get_enabled,
+        .set = _nir_set_enabled,
+    }, {
+        .name = "delayms",
+        .uuid = {
+            .u = { .type = BLE_UUID_TYPE_128 },
+            .value = { 0xFF, 0xEE, 0xDD, 0xCC, 0xBB, 0xAA, 0x99, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0x02 },
+        },
+        .type = NIR_SETTING_UINT16,
+        .min = 1,
+        .max = UINT16_MAX,
+        .default_value = 10000,
+        .nvs_key = "nir_delayms",
+        .preset = true,
+        .get = _nir_get_delayms,
+        .set = _nir_set_delayms,
+    }, {
+        .name = "burst",
+        .uuid = {
+            .u = { .type = BLE_UUID_TYPE_128 },
+            .value = { 0xFF, 0xEE, 0xDD, 0xCC, 0xBB, 0xAA, 0x99, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0x03 },
+        },
+        .type = NIR_SETTING_UINT16,
+        .min = 0,
+        .max = UINT16_MAX,
+        .default_value = 0,
+        .nvs_key = NULL,
+        .get = _nir_get_burst,
+        .set = _nir_set_burst,
+    }, {
+        .name = "bulbms",
+        .uuid = {
+            .u = { .type = BLE_UUID_TYPE_128 },
+            .value = { 0xFF, 0xEE, 0xDD, 0xCC, 0xBB, 0xAA, 0x99, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0x04 },
+        },
+        .type = NIR_SETTING_UINT32,
+        .min = 0,
+        .max = UINT32_MAX / 1000,
+        .default_value = 0,
+        .nvs_key = NULL,
+        .get = _nir_get_bulbms,
+        .set = _nir_set_bulbms,
+    }, {
+        .name = "carrierhz",
+        .uuid = {
+            .u = { .type = BLE_UUID_TYPE_128 },
+            .value = { 0xFF, 0xEE, 0xDD, 0xCC, 0xBB, 0xAA, 0x99, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0x05 },
+        },
+        .type = NIR_SETTING_UINT16,
+        .min = 30000,
+        .max = 60000,
+        .default_value = 38000,
+        .nvs_key = "nir_carrierhz",
+        .preset = true,
+        .get = _nir_get_carrierhz,
+        .set = _nir_set_carrierhz,
+    }, {
+        .name = "duty",
+        .uuid = {
+            .u = { .type = BLE_UUID_TYPE_128 },
+            .value = { 0xFF, 0xEE, 0xDD, 0xCC, 0xBB, 0xAA, 0x99, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0x06 },
+        },
+        .type = NIR_SETTING_UINT16,
+        .min = 10,
+        .max = 50,
+        .default_value = 33,
+        .nvs_key = "nir_duty",
+        .preset = true,
+        .get = _nir_get_duty,
+        .set = _nir_set_duty,
+    }, {
+        .name = "protocol",
+        .uuid = {
+            .u = { .type = BLE_UUID_TYPE_128 },
+            .value = { 0xFF, 0xEE, 0xDD, 0xCC, 0xBB, 0xAA, 0x99, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0x07 },
+        },
+        .type = NIR_SETTING_UINT16,
+        .min = 0,
+        .max = NIR_CODES_MAX - 1,
+        .default_value = 0,
+        .nvs_key = "nir_protocol",
+        .preset = true,
+        .get = _nir_get_protocol,
+        .set = _nir_set_protocol,
+        .valid = _nir_valid_protocol,
+    }, {
+        // loaded after the settings it covers so an active preset wins at boot
+        .name = "preset",
+        .uuid = {
+            .u = { .type = BLE_UUID_TYPE_128 },
+            .value = { 0xFF, 0xEE, 0xDD, 0xCC, 0xBB, 0xAA, 0x99, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0x08 },
+        },
+        .type = NIR_SETTING_UINT16,
+        .min = NIR_PRESET_NONE,
+        .max = NIR_PRESETS_MAX,
+        .default_value = NIR_PRESET_NONE,
+        .nvs_key = NIR_PRESET_NVS_KEY,
+        .get = _nir_get_preset,
+        .set = _nir_set_preset,
+    }, {
+        // store the current settings into preset N
+        .name = "presetsave",
+        .uuid = {
+            .u = { .type = BLE_UUID_TYPE_128 },
+            .value = { 0xFF, 0xEE, 0xDD, 0xCC, 0xBB, 0xAA, 0x99, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0x09 },
+        },
+        .type = NIR_SETTING_UINT16,
+        .min = 1,
+        .max = NIR_PRESETS_MAX,
+        .default_value = 0,
+        .nvs_key = NULL,
+        .get = _nir_get_presetsave,
+        .set = _nir_set_presetsave,
+    }, {
+        // write a NIR_LEARN_CMD, reads NIR_LEARN_LISTENING, NIR_LEARN_NONE or the learned protocol
+        .name = "learn",
+        .uuid = {
+            .u = { .type = BLE_UUID_TYPE_128 },
+            .value = { 0xFF, 0xEE, 0xDD, 0xCC, 0xBB, 0xAA, 0x99, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0x0A },
+        },
+        .type = NIR_SETTING_UINT16,
+        .min = NIR_LEARN_CMD_STOP,
+        .max = NIR_LEARN_CMD_CLEAR,
+        .default_value = NIR_LEARN_CMD_STOP,
+        .nvs_key = NULL,
+        .get = _nir_get_learn,
+        .set = _nir_set_learn,
+    }, {
+        // tx phy | rx phy << 8 | rssi (int8) << 16 of the current connection
+        .name = "link",
+        .uuid = {
+            .u = { .type = BLE_UUID_TYPE_128 },
+            .value = { 0xFF, 0xEE, 0xDD, 0xCC, 0xBB, 0xAA, 0x99, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0x0B },
+        },
+        .type = NIR_SETTING_UINT32,
+        .nvs_key = NULL,
+        .read_only = true,
+        .get = nir_ble_get_link,
+    }, {
+        // timer re-arms, stalled schedule restarts and advertising retries
+        .name = "recoveries",
+        .uuid = {
+            .u = { .type = BLE_UUID_TYPE_128 },
+            .value = { 0xFF, 0xEE, 0xDD, 0xCC, 0xBB, 0xAA, 0x99, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0x0C },
+        },
+        .type = NIR_SETTING_UINT32,
+        .nvs_key = NULL,
+        .read_only = true,
+        .get = nir_get_recoveries,
+    }, {
+        // frames not sent because of a failure or stall
+        .name = "missed",
+        .uuid = {
+            .u = { .type = BLE_UUID_TYPE_128 },
+            .value = { 0xFF, 0xEE, 0xDD, 0xCC, 0xBB, 0xAA, 0x99, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0x0D },
+        },
+        .type = NIR_SETTING_UINT32,
+        .nvs_key = NULL,
+        .read_only = true,
+        .get = nir_get_missed,
+    }, {
+        // wall clock, seconds since 1970, reads 0 until set
+        .name = "time",
+        .uuid = {
+            .u = { .type = BLE_UUID_TYPE_128 },
+            .value = { 0xFF, 0xEE, 0xDD, 0xCC, 0xBB, 0xAA, 0x99, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0x0E },
+        },
+        .type = NIR_SETTING_UINT32,
+        .min = 1,
+        .max = UINT32_MAX,
+        .default_value = 0,
+        .nvs_key = NULL,
+        .get = nir_schedule_get_time,
+        .set = nir_schedule_set_time,
+    }, {
+        // window open, seconds since 1970, 0 shoots whenever enabled
+        .name = "windowstart",
+        .uuid = {
+            .u = { .type = BLE_UUID_TYPE_128 },
+            .value = { 0xFF, 0xEE, 0xDD, 0xCC, 0xBB, 0xAA, 0x99, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0x0F },
+        },
+        .type = NIR_SETTING_UINT32,
+        .min = 0,
+        .max = UINT32_MAX,
+        .default_value = 0,
+        .nvs_key = "nir_winstart",
+        .get = nir_schedule_get_start,
+        .set = nir_schedule_set_start,
+    }, {
+        // window close, seconds since 1970
+        .name = "windowstop",
+        .uuid = {
+            .u = { .type = BLE_UUID_TYPE_128 },
+            .value = { 0xFF, 0xEE, 0xDD, 0xCC, 0xBB, 0xAA, 0x99, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0x10 },
+        },
+        .type = NIR_SETTING_UINT32,
+        .min = 0,
+        .max = UINT32_MAX,
+        .default_value = 0,
+        .nvs_key = "nir_winstop",
+        .get = nir_schedule_get_stop,
+        .set = nir_schedule_set_stop,
+    }, {
+        // repeat the window daily
+        .name = "windowrepeat",
+        .uuid = {
+            .u = { .type = BLE_UUID_TYPE_128 },
+            .value = { 0xFF, 0xEE, 0xDD, 0xCC, 0xBB, 0xAA, 0x99, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0x11 },
+        },
+        .type = NIR_SETTING_BOOL,
+        .min = 0,
+        .max = 1,
+        .default_value = false,
+        .nvs_key = "nir_winrepeat",
+        .get = nir_schedule_get_repeat,
+        .set = nir_schedule_set_repeat,
+    }, {
+        // heap allocations traced after init, 0 unless built with NIR_HEAP_GUARD
+        .name = "heapallocs",
+        .uuid = {
+            .u = { .type = BLE_UUID_TYPE_128 },
+            .value = { 0xFF, 0xEE, 0xDD, 0xCC, 0xBB, 0xAA, 0x99, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0x12 },
+        },
+        .type = NIR_SETTING_UINT32,
+        .nvs_key = NULL,
+        .read_only = true,
+        .get = nir_mem_get_violations,
+    },
+#ifdef NIR_TRACE
+    {
+        // write a NIR_TRACE_CMD, reads the entries recorded
+        .name = "trace",
+        .uuid = {
+            .u = { .type = BLE_UUID_TYPE_128 },
+            .value = { 0xFF, 0xEE, 0xDD, 0xCC, 0xBB, 0xAA, 0x99, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0x13 },
+        },
+        .type = NIR_SETTING_UINT16,
+        .min = NIR_TRACE_CMD_STOP,
+        .max = NIR_TRACE_CMD_RECORD,
+        .default_value = NIR_TRACE_CMD_STOP,
+        .nvs_key = NULL,
+        .get = nir_trace_status,
+        .set = nir_trace_command,
+    },
+#endif
+};
+
+const uint16_t nir_settings_count = sizeof nir_settings / sizeof nir_settings[0];
+
+// the characteristic table and per row state elsewhere are sized by NIR_SETTINGS_MAX
+_Static_assert(sizeof nir_settings / sizeof nir_settings[0] <= NIR_SETTINGS_MAX, "nir_settings exceeds NIR_SETTINGS_MAX");
+
+// writes arrive from the NimBLE host task and the serial transport
+static StaticSemaphore_t _nir_settings_mutex_buffer;
+static SemaphoreHandle_t _nir_settings_mutex;
+
+static uint32_t _nir_get_enabled(void) {
+    return nir_get_enabled();
+}
+
+static void _nir_set_enabled(uint32_t value) {
+    nir_set_enabled(value);
+}
+
+static uint32_t _nir_get_delayms(void) {
+    return nir_get_delayms();
+}
+
+static void _nir_set_delayms(uint32_t value) {
+    nir_set_delayms(value);
+}
+
+static uint32_t _nir_get_burst(void) {
+    return nir_get_burst();
+}
+
+static void _nir_set_burst(uint32_t value) {
+    nir_set_burst(value);
+}
+
+static uint32_t _nir_get_bulbms(void) {
+    return nir_get_bulbms();
+}
+
+static void _nir_set_bulbms(uint32_t value) {
+    nir_set_bulbms(value);
+}
+
+static uint32_t _nir_get_carrierhz(void) {
+    return nir_get_carrierhz();
+}
+
+static void _nir_set_carrierhz(uint32_t value) {
+    nir_set_carrierhz(value);
+}
+
+static uint32_t _nir_get_duty(void) {
+    return nir_get_duty();
+}
+
+static void _nir_set_duty(uint32_t value) {
+    nir_set_duty(value);
+}
+
+static uint32_t _nir_get_protocol(void) {
+    return nir_get_protocol();
+}
+
+static void _nir_set_protocol(uint32_t value) {
+    nir_set_protocol(value);
+}
+
+static bool _nir_valid_protocol(uint32_t value) {
+    return nir_code_get(value) != NULL;
+}
+
+static uint32_t _nir_get_preset(void) {
+    return nir_get_preset();
+}
+
+static void _nir_set_preset(uint32_t value) {
+    nir_set_preset(value);
+}
+
+static uint32_t _nir_get_presetsave(void) {
+    return 0;
+}
+
+static void _nir_set_presetsave(uint32_t value) {
+    nir_save_preset(value);
+}
+
+static uint32_t _nir_get_learn(void) {
+    return nir_get_learn();
+}
+
+static void _nir_set_learn(uint32_t value) {
+    nir_set_learn(value);
+}
+
+static uint32_t _nir_setting_nvs_read(const nir_setting_t* setting) {
+    switch (setting->type) {
+        case NIR_SETTING_BOOL:
+            return nir_nvs_read_bool(setting->nvs_key, setting->default_value);
+        case NIR_SETTING_UINT16:
+            return nir_nvs_read_uint16(setting->nvs_key, setting->default_value);
+        case NIR_SETTING_UINT32:
+            return nir_nvs_read_uint32(setting->nvs_key, setting->default_value);
+    }
+
+    return setting->default_value;
+}
+
+static void _nir_setting_nvs_write(const nir_setting_t* setting, uint32_t value) {
+    switch (setting->type) {
+        case NIR_SETTING_BOOL:
+            nir_nvs_write_bool(setting->nvs_key, value);
+            break;
+        case NIR_SETTING_UINT16:
+            nir_nvs_write_uint16(setting->nvs_key, value);
+            break;
+        case NIR_SETTING_UINT32:
+            nir_nvs_write_uint32(setting->nvs_key, value);
+            break;
+    }
+}
+
+static bool _nir_setting_in_range(const nir_setting_t* setting, uint32_t value) {
+    return value >= setting->min && value <= setting->max && (!setting->valid || setting->valid(value));
+}
+
+// The values an active preset applied are not stored under their own keys,
+// so they are stored when the preset stops being active.
+static void _nir_settings_persist_preset(void) {
+    for (uint16_t i = 0; i < nir_settings_count; i++) {
+        const nir_setting_t* setting = &nir_settings[i];
+        if (!setting->preset || !setting->nvs_key) {
+            continue;
+        }
+
+        uint32_t value = setting->get();
+        if (_nir_setting_nvs_read(setting) != value) {
+            _nir_setting_nvs_write(setting, value);
+        }
+    }
+}
+
+void nir_settings_init(void) {
+    _nir_settings_mutex = xSemaphoreCreateMutexStatic(&_nir_settings_mutex_buffer);
+}
+
+void nir_settings_lock(void) {
+    xSemaphoreTake(_nir_settings_mutex, portMAX_DELAY);
+}
+
+void nir_settings_unlock(void) {
+    xSemaphoreGive(_nir_settings_mutex);
+}
+
+void nir_settings_load(void) {
+    ESP_LOGI(TAG, "nir_settings_load");
+
+    for (uint16_t i = 0; i < nir_settings_count; i++) {
+        const nir_setting_t* setting = &nir_settings[i];
+        if (!setting->nvs_key || setting->read_only) {
+            continue; // action, nothing stored
+        }
+
+        uint32_t value = _nir_setting_nvs_read(setting);
+
+        if (!_nir_setting_in_range(setting, value)) {
+            ESP_LOGW(TAG, "%s: stored %u out of range, using %u", setting->name, value, setting->default_value);
+            value = setting->default_value;
+        }
+
+        setting->set(value);
+    }
+}
+
+const nir_setting_t* nir_settings_find(const char* name) {
+    for (uint16_t i = 0; i < nir_settings_count; i++) {
+        if (strcmp(nir_settings[i].name, name) == 0) {
+            return &nir_settings[i];
+        }
+    }
+
+    return NULL;
+}
+
+uint16_t nir_setting_size(const nir_setting_t* setting) {
+    switch (setting->type) {
+        case NIR_SETTING_BOOL:
+            return sizeof (uint8_t);
+        case NIR_SETTING_UINT16:
+            return sizeof (uint16_t);
+        case NIR_SETTING_UINT32:
+            return sizeof (uint32_t);
+    }
+
+    return 0;
+}
+
+uint16_t nir_setting_read(const nir_setting_t* setting, uint8_t* buffer) {
+    uint32_t value = setting->get();
+    uint16_t size = nir_setting_size(setting);
+
+    // little endian, matches the wire format of the original characteristics
+    for (uint16_t i = 0; i < size; i++) {
+        buffer[i] = (value >> (8 * i)) & 0xFF;
+    }
+
+    return size;
+}
+
+nir_setting_result_t nir_setting_write(const nir_setting_t* setting, const uint8_t* buffer, uint16_t len) {
+    if (setting->read_only) {
+        return NIR_SETTING_READ_ONLY;
+    }
+
+    if (len != nir_setting_size(setting)) {
+        ESP_LOGE(TAG, "%s: invalid length: %u, expected: %u", setting->name, len, nir_setting_size(setting));
+        return NIR_SETTING_INVALID_LENGTH;
+    }
+
+    uint32_t value = 0;
+    for (uint16_t i = 0; i < len; i++) {
+        value |= (uint32_t) buffer[i] << (8 * i);
+    }
+
+    if (!_nir_setting_in_range(setting, value)) {
+        ESP_LOGE(TAG, "%s: out of range: %u", setting->name, value);
+        return NIR_SETTING_OUT_OF_RANGE;
+    }
+
+    ESP_LOGD(TAG, "%s: %u", setting->name, value);
+
+    xSemaphoreTake(_nir_settings_mutex, portMAX_DELAY);
+
+    bool changed = setting->get() != value;
+
+    setting->set(value);
+
+    if (changed && setting->nvs_key) {
+        _nir_setting_nvs_write(setting, value);
+    }
+
+    // settings written individually no longer match the active preset
+    if (changed && setting->preset && nir_get_preset() != NIR_PRESET_NONE) {
+        nir_set_preset(NIR_PRESET_NONE);
+        _nir_settings_persist_preset();
+        nir_nvs_write_uint16(NIR_PRESET_NVS_KEY, NIR_PRESET_NONE);
+    }
+
+    xSemaphoreGive(_nir_settings_mutex);
+
+    return NIR_SETTING_OK;
+}
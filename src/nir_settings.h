@@ -0,0 +1,59 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <host/ble_uuid.h>
+
+#include "nikon_ir_remote.h"
+
+#ifndef NIR_SETTINGS_H
+#define NIR_SETTINGS_H
+
+/// upper bound on characteristics in the Nikon IR Remote service
+#define NIR_SETTINGS_MAX (32)
+
+typedef enum {
+    NIR_SETTING_BOOL,
+    NIR_SETTING_UINT16,
+    NIR_SETTING_UINT32,
+} nir_setting_type_t;
+
+typedef struct {
+    const char* name;
+    ble_uuid128_t uuid;
+    nir_setting_type_t type;
+    uint32_t min;
+    uint32_t max;
+    uint32_t default_value;
+    const char* nvs_key; // NULL for actions that are not persisted
+    bool preset; // covered by presets, writing it deactivates the active preset
+    bool read_only; // status, no set
+    uint32_t (*get)(void);
+    void (*set)(uint32_t value);
+    bool (*valid)(uint32_t value); // optional check beyond min and max, e.g. a learned slot that is empty
+} nir_setting_t;
+
+typedef enum {
+    NIR_SETTING_OK,
+    NIR_SETTING_INVALID_LENGTH,
+    NIR_SETTING_OUT_OF_RANGE,
+    NIR_SETTING_READ_ONLY,
+} nir_setting_result_t;
+
+extern const nir_setting_t nir_settings[];
+extern const uint16_t nir_settings_count;
+
+void nir_settings_init(void);
+void nir_settings_load(void);
+
+/// held while a setting is written, and by the control task acting on settings state
+void nir_settings_lock(void);
+void nir_settings_unlock(void);
+
+/// row by name, NULL when there is none
+const nir_setting_t* nir_settings_find(const char* name);
+
+uint16_t nir_setting_size(const nir_setting_t* setting);
+
+uint16_t nir_setting_read(const nir_setting_t* setting, uint8_t* buffer);
+nir_setting_result_t nir_setting_write(const nir_setting_t* setting, const uint8_t* buffer, uint16_t len);
+
+#endif // NIR_SETTINGS_H
@@ -1,130 +1,401 @@
+#include <inttypes.h>
+#include <string.h>
 #include <sys/time.h>
+#include <driver/rmt.h>
+#include <freertos/FreeRTOS.h>
 
 #include "nir_timer.h"
+#include "nir_pm.h"
 
-/// 38khz
-#define MODULATING_RATE ((uint64_t) (1000000 / 38000))
+/// 40 MHz XTAL / 40, 1 us per RMT tick. Unlike APB, XTAL keeps its frequency
+/// under DFS, so the driver does not hold an APB_FREQ_MAX lock while installed.
+#define RMT_CLK_DIV (40)
+#define RMT_SOURCE_HZ (40000000)
+#define RMT_CHANNEL (RMT_CHANNEL_0)
+
+/// 15 bit RMT item duration
+#define RMT_MAX_TICKS (32767)
 
 /// 5 seconds
 #define START_DELAY (5000000)
 
-static void _nir_modulate_pulse(void* args);
-
-static void _nir_pulse_on(void* arg);
-static void _nir_pulse_off(void* arg);
-static void _nir_trigger(void* arg);
-
-inline void _nir_update_led(void);
-
-typedef struct {
-    esp_timer_cb_t callback;
-    void* arg;
-    uint64_t delayus;
-} _pulse_t;
-
-volatile uint32_t _pulse_index = 0;
-
-static _pulse_t _pulse_definitions[8] = { {
-        .callback = _nir_pulse_on,
-        .arg = NULL,
-        .delayus = (2000 - 10)
-    }, {
-        .callback = _nir_pulse_off,
-        .arg = NULL,
-        .delayus = (27830 - 10)
-    }, {
-        .callback = _nir_pulse_on,
-        .arg = NULL,
-        .delayus = (400 - 10)
-    }, {
-        .callback = _nir_pulse_off,
-        .arg = NULL,
-        .delayus = (1500 - 10)
-    }, {
-        .callback = _nir_pulse_on,
-        .arg = NULL,
-        .delayus = (400 - 10)
-    }, {
-        .callback = _nir_pulse_off,
-        .arg = NULL,
-        .delayus = (3500 - 10)
-    }, {
-        .callback = _nir_pulse_on,
-        .arg = NULL,
-        .delayus = (400 - 10)
-    }, {
-        .callback = _nir_pulse_off,
-        .arg = NULL,
-        .delayus = 0
-    }
-};
+/// 63.2 ms, protocol minimum space after the final mark before the next frame
+#define MIN_FRAME_GAP (63200)
 
-static esp_timer_handle_t _modulating_timer;
-static esp_timer_handle_t _pulse_timer;
+/// allowance for the RMT to clock out the final mark before releasing the PM locks
+#define FRAME_END_MARGIN (100)
 
-static esp_timer_create_args_t _modulating_timer_args = {
-    .name = "modulating_timer",
-    .callback = _nir_modulate_pulse
-};
+/// lateness of the next frame before nir_timer_supervise re-arms the timer
+#define SUPERVISE_MARGIN (500000)
+
+static void _nir_frame_start(void* arg);
+static void _nir_frame_end(void* arg);
+
+static const nir_code_t* _code = &nir_codes[0];
+
+static uint32_t _carrier_hz = 38000;
+static uint8_t _duty_percent = 33;
+
+/// carrier in RMT source clock cycles, applied between frames by _nir_apply_carrier
+static portMUX_TYPE _carrier_lock = portMUX_INITIALIZER_UNLOCKED;
+static volatile bool _carrier_pending = false;
+static uint16_t _carrier_high_ticks = 0;
+static uint16_t _carrier_low_ticks = 0;
+
+/// a uint16_t duration splits into at most 3 RMT durations, 2 per item, plus end marker
+#define RMT_MAX_ITEMS (NIR_CODE_MAX_DURATIONS * 3 / 2 + 1)
+
+static rmt_item32_t _items[RMT_MAX_ITEMS];
+static uint16_t _items_count = 0;
+
+/// start of first mark to end of final mark
+static uint64_t _frame_us = 0;
+
+static int64_t _frame_start = 0;
+static uint64_t _frame_periodus = 0;
+
+/// 0 repeats until stopped
+static volatile uint32_t _frames_remaining = 0;
+static nir_timer_done_cb_t _frames_done = NULL;
+
+static volatile bool _running = false;
+static volatile int64_t _next_frame_at = 0;
+
+static uint32_t _recoveries = 0;
+static uint32_t _missed = 0;
+
+/// schedule restarts, and the worst frame start behind schedule since last taken
+static uint32_t _reschedules = 0;
+static int64_t _max_lateus = 0;
+
+static uint32_t _stats_frames = 0;
+static int64_t _stats_first_start = 0;
+static int64_t _stats_min_periodus = 0;
+static int64_t _stats_max_periodus = 0;
+
+static esp_timer_handle_t _pulse_timer;
+static esp_timer_handle_t _frame_end_timer;
 
 static esp_timer_create_args_t _pulse_timer_args = {
     .name = "pulse_timer",
-    .callback = _nir_trigger
+    .callback = _nir_frame_start
 };
 
+static esp_timer_create_args_t _frame_end_timer_args = {
+    .name = "frame_end_timer",
+    .callback = _nir_frame_end
+};
+
+static rmt_config_t _rmt_config = {
+    .rmt_mode = RMT_MODE_TX,
+    .channel = RMT_CHANNEL,
+    .gpio_num = LED_PIN,
+    .clk_div = RMT_CLK_DIV,
+    .mem_block_num = 1,
+    .flags = RMT_CHANNEL_FLAGS_AWARE_DFS,
+    .tx_config = {
+        .carrier_en = true,
+        .carrier_level = RMT_CARRIER_LEVEL_HIGH,
+        .idle_output_en = true,
+        .idle_level = RMT_IDLE_LEVEL_LOW,
+        .loop_en = false,
+    },
+};
+
+static void _nir_encode_items(const nir_code_t* code) {
+    uint16_t half = 0;
+
+    memset(_items, 0, sizeof _items);
+
+    for (uint16_t i = 0; i < code->count; i++) {
+        uint32_t level = (i % 2) == 0; // marks on even indexes
+        uint32_t remaining = code->durations[i];
+
+        // split anything longer than a single RMT duration
+        while (remaining && half / 2 < RMT_MAX_ITEMS - 1) {
+            uint32_t ticks = remaining > RMT_MAX_TICKS ? RMT_MAX_TICKS : remaining;
+            rmt_item32_t* item = &_items[half / 2];
+
+            if (half % 2 == 0) {
+                item->duration0 = ticks;
+                item->level0 = level;
+            } else {
+                item->duration1 = ticks;
+                item->level1 = level;
+            }
+
+            remaining -= ticks;
+            half++;
+        }
+    }
+
+    // a trailing zero duration ends the transmission after the final mark
+    _items_count = (half + 1) / 2 + (half % 2 == 0 ? 1 : 0);
+}
+
+// Reconfiguring the channel would cut into a frame that is clocking out, so
+// only the carrier registers are written, and only while no frame is.
+static void _nir_apply_carrier(void) {
+    if (!_carrier_pending) {
+        return; // nothing to do
+    }
+
+    portENTER_CRITICAL(&_carrier_lock);
+    uint16_t high_ticks = _carrier_high_ticks;
+    uint16_t low_ticks = _carrier_low_ticks;
+    _carrier_pending = false;
+    portEXIT_CRITICAL(&_carrier_lock);
+
+    esp_err_t err = rmt_set_tx_carrier(RMT_CHANNEL, true, high_ticks, low_ticks, RMT_CARRIER_LEVEL_HIGH);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "rmt_set_tx_carrier: %s", esp_err_to_name(err));
+    }
+}
+
+// Arm a one shot timer without aborting on failure. ESP_ERR_INVALID_STATE
+// means it is still armed, e.g. racing a stop, so stop and arm again.
+static esp_err_t _nir_timer_arm(esp_timer_handle_t timer, uint64_t delayus) {
+    esp_err_t err = esp_timer_start_once(timer, delayus);
+
+    if (err == ESP_ERR_INVALID_STATE) {
+        esp_timer_stop(timer);
+        err = esp_timer_start_once(timer, delayus);
+        _recoveries++;
+        ESP_LOGW(TAG, "nir_timer re-armed, recoveries: %u", _recoveries);
+    }
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_timer_start_once: %s", esp_err_to_name(err));
+    }
+
+    return err;
+}
+
 void nir_timer_init(void) {
-    gpio_pad_select_gpio(LED_PIN);
-    gpio_set_direction(LED_PIN, GPIO_MODE_OUTPUT);
+    _carrier_hz = _code->carrier_hz;
+    _duty_percent = _code->duty_percent;
+    _rmt_config.tx_config.carrier_freq_hz = _carrier_hz;
+    _rmt_config.tx_config.carrier_duty_percent = _duty_percent;
+    ESP_ERROR_CHECK(rmt_config(&_rmt_config));
+    ESP_ERROR_CHECK(rmt_driver_install(RMT_CHANNEL, 0, 0));
 
-    ESP_ERROR_CHECK(esp_timer_create(&_modulating_timer_args, &_modulating_timer));
     ESP_ERROR_CHECK(esp_timer_create(&_pulse_timer_args, &_pulse_timer));
+    ESP_ERROR_CHECK(esp_timer_create(&_frame_end_timer_args, &_frame_end_timer));
+
+    nir_timer_set_code(_code);
+}
+
+void nir_timer_set_code(const nir_code_t* code) {
+    _code = code;
+    _nir_encode_items(code);
+    _frame_us = nir_code_duration_us(code);
+
+    ESP_LOGI(TAG, "nir_timer_set_code %s frame_us: %" PRIu64 " items: %u", code->name, _frame_us, _items_count);
 }
 
-volatile bool _pulse_state = false;
-volatile bool _led_state = false;
+// Takes effect from the next frame, one in progress keeps its carrier.
+void nir_timer_set_carrier(uint32_t carrier_hz, uint8_t duty_percent) {
+    ESP_LOGI(TAG, "nir_timer_set_carrier %u Hz %u%%", carrier_hz, duty_percent);
+
+    // whole source clock cycles, as the driver's rmt_config calculates them
+    uint32_t period_ticks = RMT_SOURCE_HZ / carrier_hz;
 
-static void _nir_modulate_pulse(void* args) {
-    _pulse_state = !_pulse_state;
+    portENTER_CRITICAL(&_carrier_lock);
+    _carrier_hz = carrier_hz;
+    _duty_percent = duty_percent;
+    _carrier_high_ticks = period_ticks * duty_percent / 100;
+    _carrier_low_ticks = period_ticks - _carrier_high_ticks;
+    _carrier_pending = true;
+    portEXIT_CRITICAL(&_carrier_lock);
 
-    _nir_update_led();
+    if (!_running) {
+        _nir_apply_carrier();
+    }
 }
 
-static void _nir_pulse_on(void* args) {
-    _led_state = true;
+static void _nir_stats_frame(int64_t now) {
+    if (_stats_frames) {
+        int64_t periodus = now - _frame_start;
+
+        if (_stats_frames == 1 || periodus < _stats_min_periodus) {
+            _stats_min_periodus = periodus;
+        }
+        if (_stats_frames == 1 || periodus > _stats_max_periodus) {
+            _stats_max_periodus = periodus;
+        }
+    } else {
+        _stats_first_start = now;
+    }
+
+    _stats_frames++;
 }
 
-static void _nir_pulse_off(void* args) {
-    _led_state = false;
+static void _nir_stats_report(void) {
+    if (_stats_frames < 2) {
+        return; // no frame to frame period
+    }
+
+    int64_t elapsedus = _frame_start - _stats_first_start;
+    int64_t meanus = elapsedus / (_stats_frames - 1);
+
+    ESP_LOGI(TAG, "nir_timer frames: %u, fps: %.2f, period min/mean/max: %" PRId64 "/%" PRId64 "/%" PRId64 " us, "
+        "jitter: %" PRId64 " us",
+        _stats_frames, 1000000.0 * (_stats_frames - 1) / elapsedus,
+        _stats_min_periodus, meanus, _stats_max_periodus, _stats_max_periodus - _stats_min_periodus);
 }
 
-inline void _nir_update_led(void) {
-    gpio_set_level(LED_PIN, _pulse_state && _led_state);
+static void _nir_frame_start(void* arg) {
+    // a stop may race a callback that was already dispatched
+    if (!_running) {
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    if (now - _next_frame_at > _max_lateus) {
+        _max_lateus = now - _next_frame_at;
+    }
+
+    _nir_stats_frame(now);
+    _frame_start = now;
+    _next_frame_at = now + _frame_periodus;
+
+    // stay awake only while the RMT is clocking out the frame
+    nir_pm_acquire();
+
+    _nir_apply_carrier();
+
+    esp_err_t err = rmt_write_items(RMT_CHANNEL, _items, _items_count, false);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "rmt_write_items: %s", esp_err_to_name(err));
+        rmt_tx_stop(RMT_CHANNEL);
+        _missed++;
+    }
+
+    // still run the frame end so the schedule and burst count carry on
+    if (_nir_timer_arm(_frame_end_timer, _frame_us + FRAME_END_MARGIN) != ESP_OK) {
+        nir_pm_release(); // supervisor re-arms the next frame
+    }
 }
 
-static void _nir_trigger(void* arg) {
-    if (!_pulse_index) {
+static void _nir_frame_end(void* arg) {
+    nir_pm_release();
+
+    if (!_running) {
+        return; // stopped, do not arm the next frame or complete the sequence
     }
-    uint32_t index = _pulse_index;
-    _pulse_index = (_pulse_index + 1) % 8;
 
-    _pulse_definitions[index].callback(_pulse_definitions[index].arg);
-    ESP_ERROR_CHECK(esp_timer_start_once(_pulse_timer, _pulse_definitions[index].delayus));
+    if (_frames_remaining && --_frames_remaining == 0) {
+        _running = false;
+        _nir_stats_report();
+        if (_frames_done) {
+            _frames_done();
+        }
+        return;
+    }
+
+    // anchor on the frame start so callback latency does not accumulate
+    int64_t delayus = _next_frame_at - esp_timer_get_time();
+    _nir_timer_arm(_pulse_timer, delayus > 0 ? delayus : 0);
+}
+
+static void _nir_timer_start_frames(uint64_t startus, uint64_t periodus, uint32_t frames, nir_timer_done_cb_t done) {
+    _frame_periodus = periodus;
+    _frames_remaining = frames;
+    _frames_done = done;
+    _stats_frames = 0;
+    _next_frame_at = esp_timer_get_time() + startus;
+    _running = true;
+    _reschedules++;
+
+    _nir_timer_arm(_pulse_timer, startus);
 }
 
 void nir_timer_start(uint64_t delayus) {
-    ESP_LOGI(TAG, "nir_timer_start delayus: %llu", delayus);
-    ESP_LOGI(TAG, "nir_timer_start modulating_rate: %llu", MODULATING_RATE);
+    ESP_LOGD(TAG, "nir_timer_start delayus: %" PRIu64, delayus);
+
+    // delayus is the space after the final mark
+    _nir_timer_start_frames(START_DELAY, _frame_us + delayus, 0, NULL);
+}
 
-    // set delayus on last step and reset to first step
-    _pulse_definitions[7].delayus = delayus;
-    _pulse_index = 0;
+void nir_timer_start_at(uint64_t shotus, uint64_t delayus) {
+    ESP_LOGI(TAG, "nir_timer_start_at shotus: %" PRIu64 " delayus: %" PRIu64, shotus, delayus);
 
-    ESP_ERROR_CHECK(esp_timer_start_periodic(_modulating_timer, MODULATING_RATE));
-    ESP_ERROR_CHECK(esp_timer_start_once(_pulse_timer, START_DELAY));
+    // the camera fires on the final mark, so the frame starts ahead of the shot
+    uint64_t startus = shotus > _frame_us ? shotus - _frame_us : 0;
+    _nir_timer_start_frames(startus, _frame_us + delayus, 0, NULL);
+}
+
+void nir_timer_start_burst(uint32_t frames, nir_timer_done_cb_t done) {
+    ESP_LOGI(TAG, "nir_timer_start_burst frames: %u", frames);
+
+    _nir_timer_start_frames(0, _frame_us + MIN_FRAME_GAP, frames, done);
+}
+
+void nir_timer_start_bulb(uint64_t exposureus, nir_timer_done_cb_t done) {
+    ESP_LOGI(TAG, "nir_timer_start_bulb exposureus: %" PRIu64, exposureus);
+
+    // shutter opens on the first frame and closes on the second, both
+    // decoded at their final mark, so exposure is frame start to frame start
+    uint64_t periodus = exposureus > _frame_us + MIN_FRAME_GAP ? exposureus : _frame_us + MIN_FRAME_GAP;
+    _nir_timer_start_frames(0, periodus, 2, done);
+}
+
+uint32_t nir_timer_frames_remaining(void) {
+    return _frames_remaining;
 }
 
 void nir_timer_stop(void) {
-    ESP_ERROR_CHECK(esp_timer_stop(_modulating_timer));
-    ESP_ERROR_CHECK(esp_timer_stop(_pulse_timer));
+    _running = false;
+
+    // neither timer is armed once a burst or bulb completes, not an error
+    esp_timer_stop(_pulse_timer);
+    esp_timer_stop(_frame_end_timer);
+
+    // cut a frame short rather than leave the LED modulating
+    rmt_tx_stop(RMT_CHANNEL);
+    nir_pm_release();
+
+    _frames_remaining = 0;
+    _frames_done = NULL;
 }
 
+void nir_timer_supervise(void) {
+    if (!_running || esp_timer_is_active(_pulse_timer) || esp_timer_is_active(_frame_end_timer)) {
+        return; // idle or on schedule
+    }
+
+    int64_t lateus = esp_timer_get_time() - _next_frame_at;
+    if (lateus < SUPERVISE_MARGIN) {
+        return; // frame callback may be about to run
+    }
+
+    // count every frame slot that passed, then resume on a fresh schedule
+    uint32_t missed = _frame_periodus ? lateus / _frame_periodus + 1 : 1;
+    _missed += missed;
+    _recoveries++;
+
+    ESP_LOGW(TAG, "nir_timer stalled %" PRId64 " us, missed: %u, recoveries: %u", lateus, missed, _recoveries);
+
+    nir_pm_release();
+    _next_frame_at = esp_timer_get_time();
+    _nir_timer_arm(_pulse_timer, 0);
+}
+
+uint32_t nir_timer_get_recoveries(void) {
+    return _recoveries;
+}
+
+uint32_t nir_timer_get_missed(void) {
+    return _missed;
+}
+
+uint32_t nir_timer_get_reschedules(void) {
+    return _reschedules;
+}
+
+int64_t nir_timer_take_max_lateus(void) {
+    int64_t lateus = _max_lateus;
+    _max_lateus = 0;
+
+    return lateus;
+}
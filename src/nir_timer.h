@@ -5,14 +5,32 @@
 #include <esp_log.h>
 
 #include "nikon_ir_remote.h"
+#include "nir_code.h"
 
 #ifndef NIR_TIMER_H
 #define NIR_TIMER_H
 
 extern const char *TAG;
 
+typedef void (*nir_timer_done_cb_t)(void);
+
 void nir_timer_init(void);
+void nir_timer_set_code(const nir_code_t* code);
+void nir_timer_set_carrier(uint32_t carrier_hz, uint8_t duty_percent);
+
 void nir_timer_start(uint64_t delayus);
+void nir_timer_start_at(uint64_t shotus, uint64_t delayus);
+void nir_timer_start_burst(uint32_t frames, nir_timer_done_cb_t done);
+void nir_timer_start_bulb(uint64_t exposureus, nir_timer_done_cb_t done);
 void nir_timer_stop(void);
 
+uint32_t nir_timer_frames_remaining(void);
+
+void nir_timer_supervise(void);
+uint32_t nir_timer_get_recoveries(void);
+uint32_t nir_timer_get_missed(void);
+
+uint32_t nir_timer_get_reschedules(void);
+int64_t nir_timer_take_max_lateus(void);
+
 #endif // NIR_TIMER_H
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <string.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+
+#include "nir_trace.h"
+
+static nir_trace_entry_t _nir_trace[NIR_TRACE_MAX];
+static uint16_t _nir_trace_head = 0;
+static uint16_t _nir_trace_count = 0;
+static int64_t _nir_trace_start = 0;
+
+static volatile bool _nir_trace_recording = false;
+
+// GATT access and GAP events run on the NimBLE host task, commands may also
+// arrive from the serial transport
+static portMUX_TYPE _nir_trace_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void _nir_trace_record(uint8_t kind, uint8_t id, uint32_t value) {
+    if (!_nir_trace_recording) {
+        return;
+    }
+
+    nir_trace_entry_t entry = {
+        .at_us = (uint32_t) (esp_timer_get_time() - _nir_trace_start),
+        .value = value,
+        .kind = kind,
+        .id = id,
+    };
+
+    portENTER_CRITICAL(&_nir_trace_lock);
+    _nir_trace[_nir_trace_head] = entry;
+    _nir_trace_head = (_nir_trace_head + 1) % NIR_TRACE_MAX;
+    if (_nir_trace_count < NIR_TRACE_MAX) {
+        _nir_trace_count++;
+    }
+    portEXIT_CRITICAL(&_nir_trace_lock);
+}
+
+void nir_trace_gatt(const nir_setting_t* setting, uint8_t op, const uint8_t* value, uint16_t len) {
+    if (setting->set == nir_trace_command) {
+        return; // the recording itself
+    }
+
+    uint32_t decoded = 0;
+    for (uint16_t i = 0; value && i < len && i < sizeof decoded; i++) {
+        decoded |= (uint32_t) value[i] << (8 * i);
+    }
+
+    _nir_trace_record(op == BLE_GATT_ACCESS_OP_WRITE_CHR ? NIR_TRACE_WRITE : NIR_TRACE_READ,
+        setting - nir_settings, decoded);
+}
+
+void nir_trace_gap(const struct ble_gap_event* event) {
+    uint32_t value = 0;
+
+    switch (event->type) {
+        case BLE_GAP_EVENT_CONNECT:
+            value = event->connect.status;
+            break;
+        case BLE_GAP_EVENT_DISCONNECT:
+            value = event->disconnect.reason;
+            break;
+    }
+
+    _nir_trace_record(NIR_TRACE_GAP, event->type, value);
+}
+
+// 0 is the oldest entry still in the ring
+static nir_trace_entry_t _nir_trace_entry(uint16_t n) {
+    return _nir_trace[(_nir_trace_head + NIR_TRACE_MAX - _nir_trace_count + n) % NIR_TRACE_MAX];
+}
+
+static const char* _nir_trace_kind(uint8_t kind) {
+    switch (kind) {
+        case NIR_TRACE_READ:
+            return "read";
+        case NIR_TRACE_WRITE:
+            return "write";
+        case NIR_TRACE_GAP:
+            return "gap";
+    }
+
+    return "unknown";
+}
+
+static void _nir_trace_dump(void) {
+    ESP_LOGI(TAG, "nir_trace_dump entries: %u", _nir_trace_count);
+
+    // one JSON object per line so the serial log can be captured as a trace
+    for (uint16_t n = 0; n < _nir_trace_count; n++) {
+        nir_trace_entry_t entry = _nir_trace_entry(n);
+
+        printf("NIR_TRACE {\"at_us\":%u,\"kind\":\"%s\",\"id\":%u,\"name\":\"%s\",\"value\":%u}\n",
+            entry.at_us, _nir_trace_kind(entry.kind), entry.id,
+            entry.kind != NIR_TRACE_GAP && entry.id < nir_settings_count ? nir_settings[entry.id].name : "",
+            entry.value);
+    }
+}
+
+static void _nir_trace_record_start(void) {
+    ESP_LOGI(TAG, "nir_trace record");
+
+    portENTER_CRITICAL(&_nir_trace_lock);
+    _nir_trace_head = 0;
+    _nir_trace_count = 0;
+    _nir_trace_start = esp_timer_get_time();
+    _nir_trace_recording = true;
+    portEXIT_CRITICAL(&_nir_trace_lock);
+}
+
+static void _nir_trace_record_stop(void) {
+    if (!_nir_trace_recording) {
+        return;
+    }
+
+    _nir_trace_recording = false;
+    _nir_trace_dump();
+}
+
+uint32_t nir_trace_status(void) {
+    return _nir_trace_count;
+}
+
+void nir_trace_command(uint32_t command) {
+    ESP_LOGI(TAG, "nir_trace_command: %u", command);
+
+    switch (command) {
+        case NIR_TRACE_CMD_STOP:
+            _nir_trace_record_stop();
+            break;
+        case NIR_TRACE_CMD_RECORD:
+            _nir_trace_record_start();
+            break;
+    }
+}
@@ -0,0 +1,45 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <host/ble_hs.h>
+
+#include "nikon_ir_remote.h"
+#include "nir_settings.h"
+
+#ifndef NIR_TRACE_H
+#define NIR_TRACE_H
+
+// Define NIR_TRACE to record GATT operations and GAP events into a RAM ring,
+// dumped to the console as NIR_TRACE lines when recording stops. Traces are
+// replayed on the host, see test/host/trace_replay.c.
+// #define NIR_TRACE
+
+/// entries kept, the oldest is overwritten once full
+#define NIR_TRACE_MAX (256)
+
+/// entry kinds
+#define NIR_TRACE_READ (0)
+#define NIR_TRACE_WRITE (1)
+#define NIR_TRACE_GAP (2)
+
+/// trace characteristic commands
+#define NIR_TRACE_CMD_STOP (0)
+#define NIR_TRACE_CMD_RECORD (1)
+
+// 10 bytes per entry. at_us is relative to the start of recording and wraps
+// after ~71 minutes, id is the nir_settings row or the GAP event type.
+typedef struct __attribute__((packed)) {
+    uint32_t at_us;
+    uint32_t value;
+    uint8_t kind;
+    uint8_t id;
+} nir_trace_entry_t;
+
+extern const char *TAG;
+
+void nir_trace_gatt(const nir_setting_t* setting, uint8_t op, const uint8_t* value, uint16_t len);
+void nir_trace_gap(const struct ble_gap_event* event);
+
+uint32_t nir_trace_status(void);
+void nir_trace_command(uint32_t command);
+
+#endif // NIR_TRACE_H
@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sim.h"
+
+#include "nikon_ir_remote.h"
+#include "nir_code.h"
+#include "nir_schedule.h"
+#include "nir_settings.h"
+#include "nir_timer.h"
+
+// Control path benchmarks against the host simulator. Every case runs
+// BENCH_ITERATIONS times after a warm up, timed on the host monotonic clock,
+// with the firmware's heap allocations counted through the linker's --wrap.
+// Regression thresholds are read from a file, see bench_thresholds.txt.
+//
+// usage: nir_bench <thresholds> [results]
+
+#define BENCH_ITERATIONS (2000)
+
+/// 2021-06-01 00:00:00 UTC
+#define BENCH_WALL_S (1622505600)
+
+typedef struct {
+    const char* name;
+    void (*run)(uint32_t iteration);
+} bench_t;
+
+static uint32_t _allocs = 0;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size) {
+    _allocs++;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    _allocs++;
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    _allocs++;
+    return __real_realloc(ptr, size);
+}
+
+static void _gatt(const char* name, uint8_t op, const void* value, uint16_t len) {
+    const nir_setting_t* setting = nir_settings_find(name);
+    uint8_t out[sizeof (uint32_t)];
+    uint16_t out_len = sizeof out;
+
+    int rc = sim_ble_gatt_access(1, setting - nir_settings, op, value, len, out, &out_len);
+    if (rc) {
+        fprintf(stderr, "bench: %s access: %d\n", name, rc);
+        exit(1);
+    }
+}
+
+static void _bench_gatt_read(uint32_t iteration) {
+    _gatt("delayms", BLE_GATT_ACCESS_OP_READ_CHR, NULL, 0);
+}
+
+static void _bench_gatt_write(uint32_t iteration) {
+    // same value, validation and dispatch without a reschedule or NVS commit
+    uint16_t delayms = nir_get_delayms();
+    _gatt("delayms", BLE_GATT_ACCESS_OP_WRITE_CHR, &delayms, sizeof delayms);
+}
+
+static void _bench_gatt_write_persist(uint32_t iteration) {
+    uint16_t delayms = nir_get_delayms() ^ 1;
+    _gatt("delayms", BLE_GATT_ACCESS_OP_WRITE_CHR, &delayms, sizeof delayms);
+}
+
+static void _bench_settings_load(uint32_t iteration) {
+    nir_settings_load();
+}
+
+static void _bench_waveform_encode(uint32_t iteration) {
+    nir_timer_set_code(nir_code_get(0));
+}
+
+static void _bench_waveform_playback(uint32_t iteration) {
+    // one frame through the timer callbacks and the RMT, to the end of its gap
+    nir_timer_start_burst(1, NULL);
+    sim_run_for(nir_code_duration_us(nir_code_get(0)) + 100000);
+}
+
+static void _bench_timer_reschedule(uint32_t iteration) {
+    nir_timer_start(1000000);
+    nir_timer_stop();
+}
+
+static void _bench_schedule_open_in(uint32_t iteration) {
+    nir_schedule_open_in_us();
+}
+
+static void _bench_schedule_time_sync(uint32_t iteration) {
+    nir_schedule_set_time(BENCH_WALL_S + sim_now() / 1000000);
+}
+
+static const bench_t _benches[] = {
+    { "gatt_read", _bench_gatt_read },
+    { "gatt_write", _bench_gatt_write },
+    { "gatt_write_persist", _bench_gatt_write_persist },
+    { "settings_load", _bench_settings_load },
+    { "waveform_encode", _bench_waveform_encode },
+    { "waveform_playback", _bench_waveform_playback },
+    { "timer_reschedule", _bench_timer_reschedule },
+    { "schedule_open_in", _bench_schedule_open_in },
+    { "schedule_time_sync", _bench_schedule_time_sync },
+};
+
+static int64_t _now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// "name max_mean_ns max_allocs" per line, # starts a comment
+static bool _threshold(const char* path, const char* name, int64_t* max_ns, uint32_t* max_allocs) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        perror(path);
+        exit(1);
+    }
+
+    char line[128];
+    char row[64];
+    long long ns;
+    unsigned allocs;
+    bool found = false;
+
+    while (!found && fgets(line, sizeof line, file)) {
+        if (line[0] == '#' || sscanf(line, "%63s %lld %u", row, &ns, &allocs) != 3) {
+            continue;
+        }
+
+        if (strcmp(row, name) == 0) {
+            *max_ns = ns;
+            *max_allocs = allocs;
+            found = true;
+        }
+    }
+
+    fclose(file);
+
+    return found;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <thresholds> [results]\n", argv[0]);
+        return 2;
+    }
+
+    FILE* results = argc > 2 ? fopen(argv[2], "w") : NULL;
+    bool passed = true;
+
+    sim_boot();
+    sim_set_wall_us((int64_t) BENCH_WALL_S * 1000000);
+
+    for (uint32_t b = 0; b < sizeof _benches / sizeof _benches[0]; b++) {
+        const bench_t* bench = &_benches[b];
+        int64_t max_ns;
+        uint32_t max_allocs;
+
+        if (!_threshold(argv[1], bench->name, &max_ns, &max_allocs)) {
+            fprintf(stderr, "bench: no threshold for %s\n", bench->name);
+            return 1;
+        }
+
+        // warm up, the first pass may create NVS entries
+        bench->run(0);
+
+        uint32_t allocs = _allocs;
+        int64_t min_ns = INT64_MAX;
+        int64_t worst_ns = 0;
+        int64_t total_ns = 0;
+
+        for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+            int64_t start = _now_ns();
+            bench->run(i);
+            int64_t op_ns = _now_ns() - start;
+
+            min_ns = op_ns < min_ns ? op_ns : min_ns;
+            worst_ns = op_ns > worst_ns ? op_ns : worst_ns;
+            total_ns += op_ns;
+        }
+
+        allocs = _allocs - allocs;
+        int64_t mean_ns = total_ns / BENCH_ITERATIONS;
+        bool ok = mean_ns <= max_ns && allocs <= max_allocs;
+        passed = passed && ok;
+
+        char line[512];
+        snprintf(line, sizeof line, "{\"name\":\"%s\",\"iterations\":%d,\"mean_ns\":%lld,\"min_ns\":%lld,"
+            "\"max_ns\":%lld,\"allocs\":%u,\"threshold_ns\":%lld,\"max_allocs\":%u,\"result\":\"%s\"}",
+            bench->name, BENCH_ITERATIONS, (long long) mean_ns, (long long) min_ns, (long long) worst_ns,
+            allocs, (long long) max_ns, max_allocs, ok ? "pass" : "FAIL");
+
+        // one JSON object per line, like the other NIR_ outputs
+        printf("NIR_BENCH %s\n", line);
+        if (results) {
+            fprintf(results, "%s\n", line);
+        }
+    }
+
+    if (results) {
+        fclose(results);
+    }
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,490 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <esp_heap_caps.h>
+#include <esp_heap_trace.h>
+#include <esp_log.h>
+#include <esp_task_wdt.h>
+#include <esp_timer.h>
+#include <freertos/semphr.h>
+
+#include "sim.h"
+
+#include "nikon_ir_remote.h"
+#include "nir_mem.h"
+
+const char *TAG = "nir";
+
+esp_log_level_t sim_log_level = ESP_LOG_NONE;
+
+// linker symbols nir_mem reports on
+int _data_start, _data_end;
+int _bss_start, _bss_end;
+
+#define SIM_TIMERS_MAX (32)
+#define SIM_TASKS_MAX (16)
+
+struct esp_timer {
+    esp_timer_create_args_t args;
+    bool armed;
+    int64_t expiry;
+    uint64_t period;
+    uint64_t sequence;
+    /// fault injection
+    uint32_t fail_every;
+    uint32_t arms;
+    esp_err_t fail_err;
+    bool drop_next;
+};
+
+static struct esp_timer _sim_timers[SIM_TIMERS_MAX];
+static uint16_t _sim_timers_count = 0;
+static uint64_t _sim_sequence = 0;
+
+static int64_t _sim_now = 0;
+static int64_t _sim_wall_offset = 0;
+static void (*_sim_after_callback)(void) = NULL;
+
+static esp_reset_reason_t _sim_reset_reason = ESP_RST_POWERON;
+
+static StaticTask_t* _sim_tasks[SIM_TASKS_MAX];
+static uint16_t _sim_tasks_count = 0;
+
+static pthread_mutex_t _sim_critical = PTHREAD_MUTEX_INITIALIZER;
+
+void sim_boot(void) {
+    const char* level = getenv("NIR_SIM_LOG");
+
+    if (level) {
+        switch (level[0]) {
+            case 'E': sim_log_level = ESP_LOG_ERROR; break;
+            case 'W': sim_log_level = ESP_LOG_WARN; break;
+            case 'I': sim_log_level = ESP_LOG_INFO; break;
+            default: sim_log_level = ESP_LOG_DEBUG; break;
+        }
+    }
+
+    nir_init();
+
+    // the NimBLE host syncs with the controller once its task runs
+    ble_hs_cfg.sync_cb();
+
+    nir_mem_init_done();
+}
+
+int64_t sim_now(void) {
+    return _sim_now;
+}
+
+static struct esp_timer* _sim_timer_next(int64_t until) {
+    struct esp_timer* next = NULL;
+
+    for (uint16_t i = 0; i < _sim_timers_count; i++) {
+        struct esp_timer* timer = &_sim_timers[i];
+        if (!timer->armed || timer->expiry > until) {
+            continue;
+        }
+
+        if (!next || timer->expiry < next->expiry || (timer->expiry == next->expiry && timer->sequence < next->sequence)) {
+            next = timer;
+        }
+    }
+
+    return next;
+}
+
+void sim_run_until(int64_t us) {
+    struct esp_timer* timer;
+
+    while ((timer = _sim_timer_next(us))) {
+        _sim_now = timer->expiry > _sim_now ? timer->expiry : _sim_now;
+
+        if (timer->period) {
+            timer->expiry += timer->period;
+            timer->sequence = _sim_sequence++;
+        } else {
+            timer->armed = false;
+        }
+
+        timer->args.callback(timer->args.arg);
+
+        if (_sim_after_callback) {
+            _sim_after_callback();
+        }
+    }
+
+    _sim_now = us > _sim_now ? us : _sim_now;
+}
+
+void sim_run_for(int64_t us) {
+    sim_run_until(_sim_now + us);
+}
+
+void sim_set_after_callback(void (*hook)(void)) {
+    _sim_after_callback = hook;
+}
+
+void sim_set_wall_us(int64_t wall_us) {
+    _sim_wall_offset = wall_us - _sim_now;
+}
+
+void sim_set_reset_reason(esp_reset_reason_t reason) {
+    _sim_reset_reason = reason;
+}
+
+static struct esp_timer* _sim_timer_find(const char* name) {
+    for (uint16_t i = 0; i < _sim_timers_count; i++) {
+        if (strcmp(_sim_timers[i].args.name, name) == 0) {
+            return &_sim_timers[i];
+        }
+    }
+
+    fprintf(stderr, "sim: no timer %s\n", name);
+    abort();
+}
+
+void sim_timer_fail_every(const char* name, uint32_t nth, esp_err_t err) {
+    struct esp_timer* timer = _sim_timer_find(name);
+
+    timer->fail_every = nth;
+    timer->fail_err = err;
+    timer->arms = 0;
+}
+
+void sim_timer_drop_next(const char* name) {
+    _sim_timer_find(name)->drop_next = true;
+}
+
+bool sim_timer_active(const char* name) {
+    return _sim_timer_find(name)->armed;
+}
+
+int sim_gettimeofday(struct timeval* tv, void* tz) {
+    int64_t wall = _sim_wall_offset + _sim_now;
+
+    tv->tv_sec = wall / 1000000;
+    tv->tv_usec = wall % 1000000;
+
+    return 0;
+}
+
+int sim_settimeofday(const struct timeval* tv, const void* tz) {
+    sim_set_wall_us((int64_t) tv->tv_sec * 1000000 + tv->tv_usec);
+
+    return 0;
+}
+
+/// esp_timer
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* create_args, esp_timer_handle_t* out_handle) {
+    if (_sim_timers_count == SIM_TIMERS_MAX) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    struct esp_timer* timer = &_sim_timers[_sim_timers_count++];
+    memset(timer, 0, sizeof *timer);
+    timer->args = *create_args;
+    *out_handle = timer;
+
+    return ESP_OK;
+}
+
+static esp_err_t _sim_timer_start(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period) {
+    timer->arms++;
+    if (timer->fail_every && timer->arms % timer->fail_every == 0) {
+        return timer->fail_err;
+    }
+
+    if (timer->armed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (timer->drop_next) {
+        timer->drop_next = false;
+        return ESP_OK; // lost, as if the callback never got to run
+    }
+
+    timer->armed = true;
+    timer->expiry = _sim_now + timeout_us;
+    timer->period = period;
+    timer->sequence = _sim_sequence++;
+
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    return _sim_timer_start(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) {
+    return _sim_timer_start(timer, period, period);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    if (!timer->armed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    timer->armed = false;
+
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer) {
+    return timer->armed;
+}
+
+int64_t esp_timer_get_time(void) {
+    return _sim_now;
+}
+
+/// FreeRTOS
+
+void sim_enter_critical(portMUX_TYPE* mux) {
+    pthread_mutex_lock(&_sim_critical);
+}
+
+void sim_exit_critical(portMUX_TYPE* mux) {
+    pthread_mutex_unlock(&_sim_critical);
+}
+
+_Static_assert(sizeof (pthread_mutex_t) <= sizeof (StaticSemaphore_t), "StaticSemaphore_t too small");
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t* buffer) {
+    pthread_mutex_init((pthread_mutex_t*) buffer->storage, NULL);
+
+    return buffer;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+    return pthread_mutex_lock((pthread_mutex_t*) semaphore->storage) == 0 ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    return pthread_mutex_unlock((pthread_mutex_t*) semaphore->storage) == 0 ? pdTRUE : pdFALSE;
+}
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t function, const char* name, uint32_t stack_depth, void* param,
+    UBaseType_t priority, StackType_t* stack, StaticTask_t* task) {
+    task->function = function;
+    task->param = param;
+    task->name = name;
+    task->thread = NULL;
+    task->notified = 0;
+
+    for (uint16_t i = 0; i < _sim_tasks_count; i++) {
+        if (_sim_tasks[i] == task) {
+            return task; // restarted, e.g. a second capture
+        }
+    }
+
+    if (_sim_tasks_count < SIM_TASKS_MAX) {
+        _sim_tasks[_sim_tasks_count++] = task;
+    }
+
+    return task;
+}
+
+TaskHandle_t sim_task_find(const char* name) {
+    for (uint16_t i = 0; i < _sim_tasks_count; i++) {
+        if (strcmp(_sim_tasks[i]->name, name) == 0) {
+            return _sim_tasks[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void* _sim_task_thread(void* arg) {
+    StaticTask_t* task = arg;
+
+    task->function(task->param);
+
+    return NULL;
+}
+
+bool sim_task_start(const char* name) {
+    static pthread_t threads[SIM_TASKS_MAX];
+    static uint16_t started = 0;
+
+    StaticTask_t* task = sim_task_find(name);
+    if (!task || started == SIM_TASKS_MAX) {
+        return false;
+    }
+
+    task->thread = &threads[started];
+    if (pthread_create(&threads[started], NULL, _sim_task_thread, task) != 0) {
+        return false;
+    }
+
+    pthread_detach(threads[started++]);
+
+    return true;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (!task) {
+        pthread_exit(NULL);
+    }
+}
+
+void vTaskDelay(TickType_t ticks) {
+    usleep(ticks * 1000);
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return _sim_now / 1000;
+}
+
+TaskHandle_t xTaskGetHandle(const char* name) {
+    return sim_task_find(name);
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    __atomic_add_fetch(&task->notified, 1, __ATOMIC_SEQ_CST);
+
+    return pdPASS;
+}
+
+// from a task on a host thread, waiting on the host clock
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks) {
+    StaticTask_t* task = NULL;
+
+    for (uint16_t i = 0; i < _sim_tasks_count; i++) {
+        if (_sim_tasks[i]->thread && pthread_equal(*(pthread_t*) _sim_tasks[i]->thread, pthread_self())) {
+            task = _sim_tasks[i];
+        }
+    }
+
+    for (TickType_t waited = 0; task && !__atomic_load_n(&task->notified, __ATOMIC_SEQ_CST) && waited < ticks; waited++) {
+        usleep(1000);
+    }
+
+    if (!task || !__atomic_load_n(&task->notified, __ATOMIC_SEQ_CST)) {
+        return 0;
+    }
+
+    if (clear) {
+        return __atomic_exchange_n(&task->notified, 0, __ATOMIC_SEQ_CST);
+    }
+
+    return __atomic_fetch_sub(&task->notified, 1, __ATOMIC_SEQ_CST);
+}
+
+uint32_t sim_task_take_notify(const char* name) {
+    StaticTask_t* task = sim_task_find(name);
+
+    return task ? __atomic_exchange_n(&task->notified, 0, __ATOMIC_SEQ_CST) : 0;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    return 0;
+}
+
+esp_err_t esp_task_wdt_add(TaskHandle_t handle) {
+    return ESP_OK;
+}
+
+esp_err_t esp_task_wdt_reset(void) {
+    return ESP_OK;
+}
+
+/// system
+
+esp_reset_reason_t esp_reset_reason(void) {
+    return _sim_reset_reason;
+}
+
+const char* esp_err_to_name(esp_err_t code) {
+    switch (code) {
+        case ESP_OK: return "ESP_OK";
+        case ESP_FAIL: return "ESP_FAIL";
+        case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+    }
+
+    return "ESP_ERR";
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+    return 256 * 1024;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps) {
+    return 256 * 1024;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps) {
+    return 128 * 1024;
+}
+
+void heap_caps_get_info(multi_heap_info_t* info, uint32_t caps) {
+    memset(info, 0, sizeof *info);
+}
+
+/// heap tracing, standalone: records are kept until the buffer is full and
+/// heap_trace_start clears them
+
+static heap_trace_record_t* _sim_heap_records = NULL;
+static size_t _sim_heap_records_max = 0;
+static size_t _sim_heap_records_count = 0;
+static bool _sim_heap_tracing = false;
+
+void sim_heap_alloc(size_t size, void* caller, bool freed) {
+    if (!_sim_heap_tracing || _sim_heap_records_count == _sim_heap_records_max) {
+        return;
+    }
+
+    heap_trace_record_t* record = &_sim_heap_records[_sim_heap_records_count++];
+    memset(record, 0, sizeof *record);
+    record->address = record;
+    record->size = size;
+    record->alloced_by[0] = caller;
+    record->freed_by[0] = freed ? caller : NULL;
+}
+
+esp_err_t heap_trace_init_standalone(heap_trace_record_t* record_buffer, size_t num_records) {
+    if (_sim_heap_tracing) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    _sim_heap_records = record_buffer;
+    _sim_heap_records_max = num_records;
+
+    return ESP_OK;
+}
+
+esp_err_t heap_trace_start(heap_trace_mode_t mode) {
+    if (!_sim_heap_records) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    _sim_heap_records_count = 0;
+    _sim_heap_tracing = true;
+
+    return ESP_OK;
+}
+
+esp_err_t heap_trace_stop(void) {
+    _sim_heap_tracing = false;
+
+    return ESP_OK;
+}
+
+size_t heap_trace_get_count(void) {
+    return _sim_heap_records_count;
+}
+
+esp_err_t heap_trace_get(size_t index, heap_trace_record_t* record) {
+    if (index >= _sim_heap_records_count) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    *record = _sim_heap_records[index];
+
+    return ESP_OK;
+}
@@ -0,0 +1,133 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <driver/rmt.h>
+#include <driver/uart.h>
+#include <esp_pm.h>
+#include <esp_system.h>
+#include <freertos/task.h>
+#include <host/ble_hs.h>
+
+#ifndef SIM_H
+#define SIM_H
+
+// Host simulator the firmware sources are linked against. Time only moves
+// when a test advances the virtual clock, which runs due esp_timer callbacks
+// in order, so every run is deterministic.
+
+/// boot the firmware as app_main does and sync the BLE host
+void sim_boot(void);
+
+/// virtual clock, microseconds since boot
+int64_t sim_now(void);
+void sim_run_until(int64_t us);
+void sim_run_for(int64_t us);
+
+/// called after every timer callback, e.g. to stand in for a task
+void sim_set_after_callback(void (*hook)(void));
+
+/// wall clock is kept as an offset from the virtual clock
+void sim_set_wall_us(int64_t wall_us);
+
+void sim_set_reset_reason(esp_reset_reason_t reason);
+
+/// fail every nth esp_timer_start_once of the named timer, 0 stops
+void sim_timer_fail_every(const char* name, uint32_t nth, esp_err_t err);
+/// drop the next arm of the named timer as if its callback never ran
+void sim_timer_drop_next(const char* name);
+bool sim_timer_active(const char* name);
+
+/// NVS
+void sim_nvs_erase_all(void);
+bool sim_nvs_get_u16(const char* key, uint16_t* value);
+bool sim_nvs_get_u32(const char* key, uint32_t* value);
+bool sim_nvs_exists(const char* key);
+/// e.g. a learned code in place before sim_boot
+bool sim_nvs_set_blob(const char* key, const void* value, size_t len);
+
+/// LED output of the RMT model, picoseconds on the virtual clock
+typedef struct {
+    int64_t at_ps;
+    uint8_t level;
+} sim_edge_t;
+
+void sim_rmt_capture(sim_edge_t* edges, size_t max);
+size_t sim_rmt_captured(void);
+uint32_t sim_rmt_source_hz(rmt_channel_t channel);
+uint32_t sim_rmt_frames(void);
+int64_t sim_rmt_last_frame_us(void);
+/// start of every frame written from now on, virtual clock microseconds
+void sim_rmt_log_frames(int64_t* starts_us, size_t max);
+size_t sim_rmt_logged_frames(void);
+/// frames written while the previous one was still clocking out
+uint32_t sim_rmt_overlaps(void);
+/// carrier or channel reconfigured while a frame was clocking out
+uint32_t sim_rmt_disturbed(void);
+
+/// a frame recovered from captured edges the way an IR receiver sees it:
+/// low periods longer than SIM_IR_SPACE_MIN_US separate marks
+#define SIM_IR_MAX_DURATIONS (256)
+#define SIM_IR_SPACE_MIN_US (60)
+
+typedef struct {
+    uint16_t count;
+    double durations_us[SIM_IR_MAX_DURATIONS];
+    /// carrier from rising edge to rising edge within marks, 0 when unmodulated
+    double carrier_hz;
+    double duty_percent;
+    int64_t min_period_ps;
+    int64_t max_period_ps;
+} sim_ir_frame_t;
+
+bool sim_ir_frame(const sim_edge_t* edges, size_t count, sim_ir_frame_t* frame);
+
+/// edges of an LED, e.g. captured from a transmission, as the receiver on an
+/// RX channel sees them, queued for the next ring buffer receive, returns the
+/// items received
+size_t sim_rmt_receive(rmt_channel_t channel, const sim_edge_t* edges, size_t count);
+
+/// an allocation as heap tracing would record it
+void sim_heap_alloc(size_t size, void* caller, bool freed);
+
+/// locks held of a type, including ones drivers take
+int sim_pm_held(esp_pm_lock_type_t type);
+
+/// NimBLE
+typedef struct {
+    struct ble_gap_ext_adv_params params;
+    bool configured;
+    bool active;
+    int duration;
+    int8_t selected_tx_power;
+    uint32_t starts;
+    int64_t started_at;
+} sim_adv_t;
+
+const sim_adv_t* sim_ble_adv(uint8_t instance);
+/// fail the next count advertising starts of an instance with rc
+void sim_ble_adv_fail(uint8_t instance, uint32_t count, int rc);
+/// an advertising set that ran out its duration, or ended for reason
+void sim_ble_adv_complete(uint8_t instance, int reason);
+int sim_ble_privacy(void);
+uint32_t sim_ble_deleted_peers(void);
+uint32_t sim_ble_security_initiated(void);
+
+/// deliver a GAP event to the callback of the advertising that is running
+int sim_ble_gap_event(struct ble_gap_event* event);
+void sim_ble_connect(uint16_t conn_handle, const ble_addr_t* peer, bool bonded);
+void sim_ble_disconnect(int reason);
+
+/// a central's read or write of the nth characteristic, through the registered access callback
+int sim_ble_gatt_access(uint16_t conn_handle, uint16_t index, uint8_t op, const void* value, uint16_t len,
+    uint8_t* out, uint16_t* out_len);
+
+/// serial port backed by a file descriptor
+void sim_uart_attach(uart_port_t port, int fd);
+
+/// run a task created with xTaskCreateStatic on a host thread
+TaskHandle_t sim_task_find(const char* name);
+bool sim_task_start(const char* name);
+/// notifications given to a task that is not started, cleared, for a test standing in for it
+uint32_t sim_task_take_notify(const char* name);
+
+#endif // SIM_H
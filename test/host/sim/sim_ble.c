@@ -0,0 +1,392 @@
+#include <stdio.h>
+#include <string.h>
+#include <esp_nimble_hci.h>
+#include <nimble/nimble_port.h>
+#include <nimble/nimble_port_freertos.h>
+#include <services/gap/ble_svc_gap.h>
+#include <services/gatt/ble_svc_gatt.h>
+
+#include "sim.h"
+
+// NimBLE host and controller as far as the firmware can observe them. Calls
+// complete immediately, events only arrive when a test delivers them.
+
+#define SIM_BLE_MBUFS (8)
+#define SIM_BLE_INSTANCES (2)
+
+/// what the controller picks for tx_power 127, no preference
+#define SIM_BLE_TX_POWER_DEFAULT (3)
+#define SIM_BLE_TX_POWER_MIN (-27)
+#define SIM_BLE_TX_POWER_MAX (18)
+
+struct ble_hs_cfg ble_hs_cfg;
+
+static struct os_mbuf _sim_ble_mbufs[SIM_BLE_MBUFS];
+
+typedef struct {
+    sim_adv_t adv;
+    ble_gap_event_fn* cb;
+    void* cb_arg;
+    /// fault injection
+    uint32_t fail_count;
+    int fail_rc;
+} _sim_ble_instance_t;
+
+static _sim_ble_instance_t _sim_ble_instances[SIM_BLE_INSTANCES];
+
+static bool _sim_ble_synced = false;
+static int _sim_ble_privacy = -1;
+static uint32_t _sim_ble_deleted_peers = 0;
+static uint32_t _sim_ble_security_initiated = 0;
+
+static const struct ble_gatt_svc_def* _sim_ble_svcs = NULL;
+
+static bool _sim_ble_connected = false;
+static struct ble_gap_conn_desc _sim_ble_conn;
+
+const sim_adv_t* sim_ble_adv(uint8_t instance) {
+    return &_sim_ble_instances[instance].adv;
+}
+
+void sim_ble_adv_fail(uint8_t instance, uint32_t count, int rc) {
+    _sim_ble_instances[instance].fail_count = count;
+    _sim_ble_instances[instance].fail_rc = rc;
+}
+
+int sim_ble_privacy(void) {
+    return _sim_ble_privacy;
+}
+
+uint32_t sim_ble_deleted_peers(void) {
+    return _sim_ble_deleted_peers;
+}
+
+uint32_t sim_ble_security_initiated(void) {
+    return _sim_ble_security_initiated;
+}
+
+int sim_ble_gap_event(struct ble_gap_event* event) {
+    for (uint8_t i = 0; i < SIM_BLE_INSTANCES; i++) {
+        if (_sim_ble_instances[i].adv.configured && _sim_ble_instances[i].cb) {
+            return _sim_ble_instances[i].cb(event, _sim_ble_instances[i].cb_arg);
+        }
+    }
+
+    fprintf(stderr, "sim: no GAP event callback\n");
+    return BLE_HS_ENOENT;
+}
+
+void sim_ble_connect(uint16_t conn_handle, const ble_addr_t* peer, bool bonded) {
+    memset(&_sim_ble_conn, 0, sizeof _sim_ble_conn);
+    _sim_ble_conn.conn_handle = conn_handle;
+    _sim_ble_conn.peer_id_addr = *peer;
+    _sim_ble_conn.peer_ota_addr = *peer;
+    _sim_ble_conn.sec_state.bonded = bonded;
+    _sim_ble_connected = true;
+
+    // the instance the central connected through stops advertising
+    for (uint8_t i = 0; i < SIM_BLE_INSTANCES; i++) {
+        _sim_ble_instances[i].adv.active = false;
+    }
+
+    struct ble_gap_event event;
+    memset(&event, 0, sizeof event);
+    event.type = BLE_GAP_EVENT_CONNECT;
+    event.connect.status = 0;
+    event.connect.conn_handle = conn_handle;
+
+    sim_ble_gap_event(&event);
+}
+
+void sim_ble_disconnect(int reason) {
+    struct ble_gap_event event;
+    memset(&event, 0, sizeof event);
+    event.type = BLE_GAP_EVENT_DISCONNECT;
+    event.disconnect.reason = reason;
+    event.disconnect.conn = _sim_ble_conn;
+
+    _sim_ble_connected = false;
+
+    sim_ble_gap_event(&event);
+}
+
+int sim_ble_gatt_access(uint16_t conn_handle, uint16_t index, uint8_t op, const void* value, uint16_t len,
+    uint8_t* out, uint16_t* out_len) {
+    const struct ble_gatt_chr_def* chr = &_sim_ble_svcs[0].characteristics[index];
+
+    struct os_mbuf* om = os_msys_get_pkthdr(len, 0);
+    if (value) {
+        os_mbuf_append(om, value, len);
+    }
+
+    struct ble_gatt_access_ctxt ctxt = {
+        .op = op,
+        .om = om,
+        .chr = chr,
+    };
+
+    int rc = chr->access_cb(conn_handle, index + 1, &ctxt, chr->arg);
+
+    if (out && out_len) {
+        ble_hs_mbuf_to_flat(om, out, *out_len, out_len);
+    }
+
+    os_mbuf_free_chain(om);
+
+    return rc;
+}
+
+/// mbufs
+
+struct os_mbuf* os_msys_get_pkthdr(uint16_t dsize, uint16_t user_hdr_len) {
+    for (uint16_t i = 0; i < SIM_BLE_MBUFS; i++) {
+        if (!_sim_ble_mbufs[i].in_use) {
+            _sim_ble_mbufs[i].in_use = true;
+            _sim_ble_mbufs[i].om_len = 0;
+            _sim_ble_mbufs[i].om_size = sizeof _sim_ble_mbufs[i].om_data;
+            return &_sim_ble_mbufs[i];
+        }
+    }
+
+    return NULL;
+}
+
+int os_mbuf_append(struct os_mbuf* om, const void* data, uint16_t len) {
+    if (om->om_len + len > om->om_size) {
+        return BLE_HS_ENOMEM;
+    }
+
+    memcpy(om->om_data + om->om_len, data, len);
+    om->om_len += len;
+
+    return 0;
+}
+
+int os_mbuf_free_chain(struct os_mbuf* om) {
+    om->in_use = false;
+
+    return 0;
+}
+
+int ble_hs_mbuf_to_flat(const struct os_mbuf* om, void* flat, uint16_t max_len, uint16_t* out_copy_len) {
+    uint16_t len = om->om_len < max_len ? om->om_len : max_len;
+
+    memcpy(flat, om->om_data, len);
+    if (out_copy_len) {
+        *out_copy_len = len;
+    }
+
+    return len < om->om_len ? BLE_HS_EMSGSIZE : 0;
+}
+
+/// host
+
+esp_err_t esp_nimble_hci_and_controller_init(void) {
+    return ESP_OK;
+}
+
+void nimble_port_init(void) {
+}
+
+void nimble_port_run(void) {
+}
+
+void nimble_port_freertos_init(TaskFunction_t host_task_fn) {
+    _sim_ble_synced = true;
+}
+
+void nimble_port_freertos_deinit(void) {
+}
+
+int ble_hs_synced(void) {
+    return _sim_ble_synced;
+}
+
+int ble_hs_id_infer_auto(int privacy, uint8_t* out_addr_type) {
+    _sim_ble_privacy = privacy;
+    *out_addr_type = privacy ? BLE_OWN_ADDR_RPA_PUBLIC_DEFAULT : BLE_OWN_ADDR_PUBLIC;
+
+    return 0;
+}
+
+int ble_hs_id_copy_addr(uint8_t id_addr_type, uint8_t* out_id_addr, int* out_is_nrpa) {
+    static const uint8_t addr[6] = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06 };
+
+    memcpy(out_id_addr, addr, sizeof addr);
+    if (out_is_nrpa) {
+        *out_is_nrpa = 0;
+    }
+
+    return 0;
+}
+
+void ble_svc_gap_init(void) {
+}
+
+int ble_svc_gap_device_name_set(const char* name) {
+    return 0;
+}
+
+void ble_svc_gatt_init(void) {
+}
+
+void ble_svc_gatt_changed(uint16_t start_handle, uint16_t end_handle) {
+}
+
+int ble_gatts_count_cfg(const struct ble_gatt_svc_def* defs) {
+    return 0;
+}
+
+int ble_gatts_add_svcs(const struct ble_gatt_svc_def* svcs) {
+    _sim_ble_svcs = svcs;
+
+    return 0;
+}
+
+void ble_store_config_init(void) {
+}
+
+int ble_store_util_delete_peer(const ble_addr_t* peer_id_addr) {
+    _sim_ble_deleted_peers++;
+
+    return 0;
+}
+
+int ble_store_util_status_rr(struct ble_store_status_event* event, void* arg) {
+    return 0;
+}
+
+/// GAP
+
+int ble_hs_adv_set_fields_mbuf(const struct ble_hs_adv_fields* adv_fields, struct os_mbuf* om) {
+    uint8_t header[2] = { adv_fields->name_len + 1, adv_fields->name_is_complete ? 0x09 : 0x08 };
+
+    if (os_mbuf_append(om, header, sizeof header)) {
+        return BLE_HS_EMSGSIZE;
+    }
+
+    return os_mbuf_append(om, adv_fields->name, adv_fields->name_len) ? BLE_HS_EMSGSIZE : 0;
+}
+
+int ble_gap_ext_adv_configure(uint8_t instance, const struct ble_gap_ext_adv_params* params, int8_t* selected_tx_power,
+    ble_gap_event_fn* cb, void* cb_arg) {
+    if (instance >= SIM_BLE_INSTANCES) {
+        return BLE_HS_EINVAL;
+    }
+
+    _sim_ble_instance_t* sim = &_sim_ble_instances[instance];
+    if (sim->adv.active) {
+        return BLE_HS_EBUSY;
+    }
+
+    int8_t tx_power = params->tx_power;
+    if (tx_power == 127) {
+        tx_power = SIM_BLE_TX_POWER_DEFAULT;
+    } else if (tx_power > SIM_BLE_TX_POWER_MAX) {
+        tx_power = SIM_BLE_TX_POWER_MAX;
+    } else if (tx_power < SIM_BLE_TX_POWER_MIN) {
+        tx_power = SIM_BLE_TX_POWER_MIN;
+    }
+
+    sim->adv.params = *params;
+    sim->adv.configured = true;
+    sim->adv.selected_tx_power = tx_power;
+    sim->cb = cb;
+    sim->cb_arg = cb_arg;
+
+    if (selected_tx_power) {
+        *selected_tx_power = tx_power;
+    }
+
+    return 0;
+}
+
+int ble_gap_ext_adv_set_data(uint8_t instance, struct os_mbuf* data) {
+    os_mbuf_free_chain(data);
+
+    return instance < SIM_BLE_INSTANCES && _sim_ble_instances[instance].adv.configured ? 0 : BLE_HS_EINVAL;
+}
+
+int ble_gap_ext_adv_start(uint8_t instance, int duration, int max_events) {
+    if (instance >= SIM_BLE_INSTANCES || !_sim_ble_instances[instance].adv.configured) {
+        return BLE_HS_EINVAL;
+    }
+
+    sim_adv_t* adv = &_sim_ble_instances[instance].adv;
+    if (adv->active) {
+        return BLE_HS_EALREADY;
+    }
+
+    if (_sim_ble_instances[instance].fail_count) {
+        _sim_ble_instances[instance].fail_count--;
+        return _sim_ble_instances[instance].fail_rc;
+    }
+
+    adv->active = true;
+    adv->duration = duration;
+    adv->starts++;
+    adv->started_at = sim_now();
+
+    return 0;
+}
+
+void sim_ble_adv_complete(uint8_t instance, int reason) {
+    _sim_ble_instance_t* sim = &_sim_ble_instances[instance];
+
+    struct ble_gap_event event;
+    memset(&event, 0, sizeof event);
+    event.type = BLE_GAP_EVENT_ADV_COMPLETE;
+    event.adv_complete.reason = reason;
+    event.adv_complete.instance = instance;
+
+    sim->adv.active = false;
+
+    sim->cb(&event, sim->cb_arg);
+}
+
+int ble_gap_ext_adv_stop(uint8_t instance) {
+    if (instance >= SIM_BLE_INSTANCES || !_sim_ble_instances[instance].adv.active) {
+        return BLE_HS_EALREADY;
+    }
+
+    _sim_ble_instances[instance].adv.active = false;
+
+    return 0;
+}
+
+bool ble_gap_ext_adv_active(uint8_t instance) {
+    return instance < SIM_BLE_INSTANCES && _sim_ble_instances[instance].adv.active;
+}
+
+int ble_gap_conn_find(uint16_t handle, struct ble_gap_conn_desc* out_desc) {
+    if (!_sim_ble_connected || handle != _sim_ble_conn.conn_handle) {
+        return BLE_HS_ENOTCONN;
+    }
+
+    *out_desc = _sim_ble_conn;
+
+    return 0;
+}
+
+int ble_gap_conn_rssi(uint16_t conn_handle, int8_t* out_rssi) {
+    *out_rssi = -50;
+
+    return 0;
+}
+
+int ble_gap_security_initiate(uint16_t conn_handle) {
+    _sim_ble_security_initiated++;
+
+    return 0;
+}
+
+int ble_gap_read_le_phy(uint16_t conn_handle, uint8_t* tx_phy, uint8_t* rx_phy) {
+    *tx_phy = BLE_HCI_LE_PHY_1M;
+    *rx_phy = BLE_HCI_LE_PHY_1M;
+
+    return 0;
+}
+
+int ble_gap_set_prefered_le_phy(uint16_t conn_handle, uint8_t tx_phys_mask, uint8_t rx_phys_mask, uint16_t phy_opts) {
+    return 0;
+}
@@ -0,0 +1,162 @@
+#include <string.h>
+#include <nvs.h>
+#include <nvs_flash.h>
+
+#include "sim.h"
+
+#define SIM_NVS_ENTRIES (64)
+#define SIM_NVS_KEY_LEN (16)
+#define SIM_NVS_VALUE_MAX (512)
+
+typedef enum {
+    SIM_NVS_U16,
+    SIM_NVS_U32,
+    SIM_NVS_BLOB,
+} _sim_nvs_type_t;
+
+typedef struct {
+    char key[SIM_NVS_KEY_LEN];
+    _sim_nvs_type_t type;
+    size_t len;
+    uint8_t value[SIM_NVS_VALUE_MAX];
+    bool used;
+} _sim_nvs_entry_t;
+
+static _sim_nvs_entry_t _sim_nvs[SIM_NVS_ENTRIES];
+
+static _sim_nvs_entry_t* _sim_nvs_find(const char* key) {
+    for (uint16_t i = 0; i < SIM_NVS_ENTRIES; i++) {
+        if (_sim_nvs[i].used && strcmp(_sim_nvs[i].key, key) == 0) {
+            return &_sim_nvs[i];
+        }
+    }
+
+    return NULL;
+}
+
+static esp_err_t _sim_nvs_get(const char* key, _sim_nvs_type_t type, void* value, size_t* len) {
+    _sim_nvs_entry_t* entry = _sim_nvs_find(key);
+    if (!entry || entry->type != type) {
+        return ESP_ERR_NVS_NOT_FOUND; // NVS keys are typed
+    }
+
+    if (type == SIM_NVS_BLOB) {
+        if (!value) {
+            *len = entry->len;
+            return ESP_OK;
+        }
+        if (*len < entry->len) {
+            return ESP_ERR_NVS_INVALID_LENGTH;
+        }
+        *len = entry->len;
+    }
+
+    memcpy(value, entry->value, entry->len);
+
+    return ESP_OK;
+}
+
+static esp_err_t _sim_nvs_set(const char* key, _sim_nvs_type_t type, const void* value, size_t len) {
+    if (strlen(key) >= SIM_NVS_KEY_LEN) {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+    if (len > SIM_NVS_VALUE_MAX) {
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+
+    _sim_nvs_entry_t* entry = _sim_nvs_find(key);
+    for (uint16_t i = 0; !entry && i < SIM_NVS_ENTRIES; i++) {
+        if (!_sim_nvs[i].used) {
+            entry = &_sim_nvs[i];
+        }
+    }
+    if (!entry) {
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+
+    strcpy(entry->key, key);
+    entry->type = type;
+    entry->len = len;
+    memcpy(entry->value, value, len);
+    entry->used = true;
+
+    return ESP_OK;
+}
+
+void sim_nvs_erase_all(void) {
+    memset(_sim_nvs, 0, sizeof _sim_nvs);
+}
+
+bool sim_nvs_get_u16(const char* key, uint16_t* value) {
+    return _sim_nvs_get(key, SIM_NVS_U16, value, NULL) == ESP_OK;
+}
+
+bool sim_nvs_get_u32(const char* key, uint32_t* value) {
+    return _sim_nvs_get(key, SIM_NVS_U32, value, NULL) == ESP_OK;
+}
+
+bool sim_nvs_set_blob(const char* key, const void* value, size_t len) {
+    return _sim_nvs_set(key, SIM_NVS_BLOB, value, len) == ESP_OK;
+}
+
+bool sim_nvs_exists(const char* key) {
+    return _sim_nvs_find(key) != NULL;
+}
+
+esp_err_t nvs_flash_init(void) {
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void) {
+    sim_nvs_erase_all();
+
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char* name, nvs_open_mode_t open_mode, nvs_handle_t* out_handle) {
+    *out_handle = 1;
+
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle) {
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_u16(nvs_handle_t handle, const char* key, uint16_t* out_value) {
+    return _sim_nvs_get(key, SIM_NVS_U16, out_value, NULL);
+}
+
+esp_err_t nvs_set_u16(nvs_handle_t handle, const char* key, uint16_t value) {
+    return _sim_nvs_set(key, SIM_NVS_U16, &value, sizeof value);
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char* key, uint32_t* out_value) {
+    return _sim_nvs_get(key, SIM_NVS_U32, out_value, NULL);
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char* key, uint32_t value) {
+    return _sim_nvs_set(key, SIM_NVS_U32, &value, sizeof value);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char* key, void* out_value, size_t* length) {
+    return _sim_nvs_get(key, SIM_NVS_BLOB, out_value, length);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char* key, const void* value, size_t length) {
+    return _sim_nvs_set(key, SIM_NVS_BLOB, value, length);
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key) {
+    _sim_nvs_entry_t* entry = _sim_nvs_find(key);
+    if (!entry) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    entry->used = false;
+
+    return ESP_OK;
+}
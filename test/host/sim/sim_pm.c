@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <string.h>
+#include <esp_pm.h>
+
+#include "sim.h"
+
+// Locks are counted like the ESP-IDF implementation and the time spent in
+// each mode accumulates on the virtual clock, so esp_pm_dump_locks prints
+// the same "Mode stats" table the device does.
+
+#define SIM_PM_LOCKS_MAX (16)
+
+typedef enum {
+    SIM_PM_SLEEP,
+    SIM_PM_APB_MIN,
+    SIM_PM_APB_MAX,
+    SIM_PM_CPU_MAX,
+    SIM_PM_MODES,
+} _sim_pm_mode_t;
+
+struct esp_pm_lock {
+    esp_pm_lock_type_t type;
+    const char* name;
+    int count;
+};
+
+static struct esp_pm_lock _sim_pm_locks[SIM_PM_LOCKS_MAX];
+static uint16_t _sim_pm_locks_count = 0;
+
+static const char* _sim_pm_mode_names[SIM_PM_MODES] = { "SLEEP", "APB_MIN", "APB_MAX", "CPU_MAX" };
+static int _sim_pm_mode_mhz[SIM_PM_MODES] = { 40, 40, 80, 240 };
+
+static int64_t _sim_pm_mode_us[SIM_PM_MODES];
+static int64_t _sim_pm_since = 0;
+static bool _sim_pm_light_sleep = false;
+
+int sim_pm_held(esp_pm_lock_type_t type) {
+    int held = 0;
+
+    for (uint16_t i = 0; i < _sim_pm_locks_count; i++) {
+        if (_sim_pm_locks[i].type == type) {
+            held += _sim_pm_locks[i].count;
+        }
+    }
+
+    return held;
+}
+
+static _sim_pm_mode_t _sim_pm_mode(void) {
+    if (sim_pm_held(ESP_PM_CPU_FREQ_MAX)) {
+        return SIM_PM_CPU_MAX;
+    }
+    if (sim_pm_held(ESP_PM_APB_FREQ_MAX)) {
+        return SIM_PM_APB_MAX;
+    }
+    if (sim_pm_held(ESP_PM_NO_LIGHT_SLEEP) || !_sim_pm_light_sleep) {
+        return SIM_PM_APB_MIN;
+    }
+
+    return SIM_PM_SLEEP;
+}
+
+// credit the time since the last change to the mode that was in effect
+static void _sim_pm_account(void) {
+    int64_t now = sim_now();
+
+    _sim_pm_mode_us[_sim_pm_mode()] += now - _sim_pm_since;
+    _sim_pm_since = now;
+}
+
+esp_err_t esp_pm_configure(const void* config) {
+    const esp_pm_config_esp32s3_t* pm_config = config;
+
+    _sim_pm_account();
+    _sim_pm_light_sleep = pm_config->light_sleep_enable;
+    _sim_pm_mode_mhz[SIM_PM_CPU_MAX] = pm_config->max_freq_mhz;
+    _sim_pm_mode_mhz[SIM_PM_APB_MIN] = pm_config->min_freq_mhz;
+    _sim_pm_mode_mhz[SIM_PM_SLEEP] = pm_config->min_freq_mhz;
+
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t lock_type, int arg, const char* name, esp_pm_lock_handle_t* out_handle) {
+    if (_sim_pm_locks_count == SIM_PM_LOCKS_MAX) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    struct esp_pm_lock* lock = &_sim_pm_locks[_sim_pm_locks_count++];
+    lock->type = lock_type;
+    lock->name = name;
+    lock->count = 0;
+    *out_handle = lock;
+
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle) {
+    _sim_pm_account();
+    handle->count++;
+
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle) {
+    if (!handle->count) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    _sim_pm_account();
+    handle->count--;
+
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_dump_locks(FILE* stream) {
+    static const char* type_names[] = { "CPU_FREQ_MAX", "APB_FREQ_MAX", "NO_LIGHT_SLEEP" };
+
+    _sim_pm_account();
+    int64_t now = sim_now() ? sim_now() : 1;
+
+    fprintf(stream, "Lock stats:\n");
+    fprintf(stream, "%-15s  %-14s  %-5s  %-8s\n", "Name", "Type", "Arg", "Active");
+    for (uint16_t i = 0; i < _sim_pm_locks_count; i++) {
+        fprintf(stream, "%-15s  %-14s  %-5d  %-8d\n", _sim_pm_locks[i].name, type_names[_sim_pm_locks[i].type], 0,
+            _sim_pm_locks[i].count);
+    }
+
+    fprintf(stream, "Mode stats:\n");
+    fprintf(stream, "%-8s  %-10s  %-20s  %-10s\n", "Mode", "CPU_freq", "Time(us)", "Time(%)");
+    for (int i = 0; i < SIM_PM_MODES; i++) {
+        if (i == SIM_PM_SLEEP && !_sim_pm_light_sleep) {
+            continue;
+        }
+
+        fprintf(stream, "%-8s  %-3dM%-7s %-20lld  %-2d%%\n", _sim_pm_mode_names[i], _sim_pm_mode_mhz[i], "",
+            (long long) _sim_pm_mode_us[i], (int) (_sim_pm_mode_us[i] * 100 / now));
+    }
+
+    return ESP_OK;
+}
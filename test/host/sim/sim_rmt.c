@@ -0,0 +1,394 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <driver/rmt.h>
+#include <esp_pm.h>
+
+#include "sim.h"
+
+// Transmission as the hardware would clock it out: item durations count
+// channel ticks of the source clock divided by clk_div, and the carrier is
+// high_ticks/low_ticks of the undivided source clock, gated by mark levels.
+// The carrier ticks follow the ESP-IDF 4.4 driver's calculation in rmt_config.
+
+#define SIM_RMT_APB_HZ (80000000)
+#define SIM_RMT_XTAL_HZ (40000000)
+
+/// largest receive buffer modelled, in items
+#define SIM_RMT_RX_ITEMS_MAX (8192)
+
+typedef struct {
+    rmt_config_t config;
+    bool installed;
+    uint32_t source_hz;
+    bool carrier_en;
+    uint16_t carrier_high;
+    uint16_t carrier_low;
+    int64_t busy_until_ps;
+    esp_pm_lock_handle_t pm_lock;
+    /// a received frame waiting in the ring buffer
+    size_t rx_buf_size;
+    size_t rx_count;
+    bool rx_pending;
+} _sim_rmt_channel_t;
+
+static _sim_rmt_channel_t _sim_rmt[RMT_CHANNEL_MAX];
+
+static rmt_item32_t _sim_rmt_rx_items[RMT_CHANNEL_MAX][SIM_RMT_RX_ITEMS_MAX];
+
+static sim_edge_t* _sim_rmt_edges = NULL;
+static size_t _sim_rmt_edges_max = 0;
+static size_t _sim_rmt_edges_count = 0;
+static uint8_t _sim_rmt_level = 0;
+
+static int64_t* _sim_rmt_starts = NULL;
+static size_t _sim_rmt_starts_max = 0;
+static size_t _sim_rmt_starts_count = 0;
+
+static uint32_t _sim_rmt_frames = 0;
+static int64_t _sim_rmt_last_frame_us = 0;
+static uint32_t _sim_rmt_overlaps = 0;
+static uint32_t _sim_rmt_disturbed = 0;
+
+static int64_t _sim_rmt_now_ps(void) {
+    return sim_now() * 1000000;
+}
+
+static bool _sim_rmt_busy(rmt_channel_t channel) {
+    return _sim_rmt_now_ps() < _sim_rmt[channel].busy_until_ps;
+}
+
+static void _sim_rmt_edge(int64_t at_ps, uint8_t level) {
+    if (level == _sim_rmt_level) {
+        return;
+    }
+
+    _sim_rmt_level = level;
+
+    if (_sim_rmt_edges && _sim_rmt_edges_count < _sim_rmt_edges_max) {
+        _sim_rmt_edges[_sim_rmt_edges_count].at_ps = at_ps;
+        _sim_rmt_edges[_sim_rmt_edges_count].level = level;
+        _sim_rmt_edges_count++;
+    }
+}
+
+void sim_rmt_capture(sim_edge_t* edges, size_t max) {
+    _sim_rmt_edges = edges;
+    _sim_rmt_edges_max = max;
+    _sim_rmt_edges_count = 0;
+}
+
+size_t sim_rmt_captured(void) {
+    return _sim_rmt_edges_count;
+}
+
+void sim_rmt_log_frames(int64_t* starts_us, size_t max) {
+    _sim_rmt_starts = starts_us;
+    _sim_rmt_starts_max = max;
+    _sim_rmt_starts_count = 0;
+}
+
+size_t sim_rmt_logged_frames(void) {
+    return _sim_rmt_starts_count;
+}
+
+uint32_t sim_rmt_source_hz(rmt_channel_t channel) {
+    return _sim_rmt[channel].source_hz;
+}
+
+uint32_t sim_rmt_frames(void) {
+    return _sim_rmt_frames;
+}
+
+int64_t sim_rmt_last_frame_us(void) {
+    return _sim_rmt_last_frame_us;
+}
+
+uint32_t sim_rmt_overlaps(void) {
+    return _sim_rmt_overlaps;
+}
+
+uint32_t sim_rmt_disturbed(void) {
+    return _sim_rmt_disturbed;
+}
+
+esp_err_t rmt_config(const rmt_config_t* config) {
+    _sim_rmt_channel_t* channel = &_sim_rmt[config->channel];
+
+    if (config->rmt_mode == RMT_MODE_TX && _sim_rmt_busy(config->channel)) {
+        _sim_rmt_disturbed++;
+    }
+
+    channel->config = *config;
+    channel->source_hz = config->flags & RMT_CHANNEL_FLAGS_AWARE_DFS ? SIM_RMT_XTAL_HZ : SIM_RMT_APB_HZ;
+
+    if (config->rmt_mode == RMT_MODE_TX) {
+        channel->carrier_en = config->tx_config.carrier_en;
+
+        if (config->tx_config.carrier_en) {
+            if (!config->tx_config.carrier_freq_hz) {
+                return ESP_ERR_INVALID_ARG;
+            }
+
+            uint32_t duty_div = channel->source_hz / config->tx_config.carrier_freq_hz;
+            channel->carrier_high = duty_div * config->tx_config.carrier_duty_percent / 100;
+            channel->carrier_low = duty_div - channel->carrier_high;
+        }
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t rmt_driver_install(rmt_channel_t channel, size_t rx_buf_size, int intr_alloc_flags) {
+    if (_sim_rmt[channel].installed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    _sim_rmt[channel].installed = true;
+    _sim_rmt[channel].rx_buf_size = rx_buf_size;
+
+    // the driver holds the APB frequency for as long as an APB clocked channel is installed
+    if (_sim_rmt[channel].source_hz == SIM_RMT_APB_HZ) {
+        esp_pm_lock_create(ESP_PM_APB_FREQ_MAX, 0, "rmt", &_sim_rmt[channel].pm_lock);
+        esp_pm_lock_acquire(_sim_rmt[channel].pm_lock);
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t rmt_set_tx_carrier(rmt_channel_t channel, bool carrier_en, uint16_t high_level, uint16_t low_level,
+    rmt_carrier_level_t carrier_level) {
+    if (_sim_rmt_busy(channel)) {
+        _sim_rmt_disturbed++;
+    }
+
+    _sim_rmt[channel].carrier_en = carrier_en;
+    _sim_rmt[channel].carrier_high = high_level;
+    _sim_rmt[channel].carrier_low = low_level;
+
+    return ESP_OK;
+}
+
+static void _sim_rmt_mark(_sim_rmt_channel_t* channel, int64_t start_ps, int64_t end_ps) {
+    if (!channel->carrier_en || !channel->carrier_high || !channel->carrier_low) {
+        _sim_rmt_edge(start_ps, channel->carrier_en ? 0 : 1);
+        return;
+    }
+
+    int64_t source_ps = 1000000000000LL / channel->source_hz;
+    int64_t high_ps = channel->carrier_high * source_ps;
+    int64_t period_ps = (channel->carrier_high + channel->carrier_low) * source_ps;
+
+    for (int64_t at = start_ps; at < end_ps; at += period_ps) {
+        _sim_rmt_edge(at, 1);
+        _sim_rmt_edge(at + high_ps < end_ps ? at + high_ps : end_ps, 0);
+    }
+}
+
+esp_err_t rmt_write_items(rmt_channel_t channel, const rmt_item32_t* items, int item_num, bool wait_tx_done) {
+    _sim_rmt_channel_t* rmt = &_sim_rmt[channel];
+
+    if (!rmt->installed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (_sim_rmt_busy(channel)) {
+        _sim_rmt_overlaps++;
+    }
+
+    _sim_rmt_frames++;
+    _sim_rmt_last_frame_us = sim_now();
+    if (_sim_rmt_starts && _sim_rmt_starts_count < _sim_rmt_starts_max) {
+        _sim_rmt_starts[_sim_rmt_starts_count++] = sim_now();
+    }
+
+    int64_t tick_ps = rmt->config.clk_div * (1000000000000LL / rmt->source_hz);
+    int64_t at = _sim_rmt_now_ps();
+
+    for (int i = 0; i < item_num * 2; i++) {
+        const rmt_item32_t* item = &items[i / 2];
+        uint32_t ticks = i % 2 == 0 ? item->duration0 : item->duration1;
+        uint32_t level = i % 2 == 0 ? item->level0 : item->level1;
+
+        if (!ticks) {
+            break; // end marker
+        }
+
+        int64_t end = at + ticks * tick_ps;
+        if (level) {
+            _sim_rmt_mark(rmt, at, end);
+        } else {
+            _sim_rmt_edge(at, 0);
+        }
+        at = end;
+    }
+
+    _sim_rmt_edge(at, 0); // idle level
+    rmt->busy_until_ps = at;
+
+    return ESP_OK;
+}
+
+esp_err_t rmt_tx_stop(rmt_channel_t channel) {
+    int64_t now = _sim_rmt_now_ps();
+
+    if (_sim_rmt_busy(channel)) {
+        // the rest of the frame is never clocked out
+        while (_sim_rmt_edges_count && _sim_rmt_edges[_sim_rmt_edges_count - 1].at_ps > now) {
+            _sim_rmt_edges_count--;
+        }
+        _sim_rmt_level = _sim_rmt_edges_count ? _sim_rmt_edges[_sim_rmt_edges_count - 1].level : 0;
+        _sim_rmt_edge(now, 0);
+    }
+
+    _sim_rmt[channel].busy_until_ps = now;
+
+    return ESP_OK;
+}
+
+esp_err_t rmt_rx_start(rmt_channel_t channel, bool rx_idx_rst) {
+    return ESP_OK;
+}
+
+esp_err_t rmt_rx_stop(rmt_channel_t channel) {
+    return ESP_OK;
+}
+
+esp_err_t rmt_get_ringbuf_handle(rmt_channel_t channel, RingbufHandle_t* buf_handle) {
+    *buf_handle = &_sim_rmt[channel];
+
+    return ESP_OK;
+}
+
+// The receiver is active low. Durations are counted in channel ticks from
+// the tick each edge is sampled on, pulses shorter than the filter are lost
+// and the frame ends on the idle level. Ping-pong copies the channel memory
+// out as it fills, so only the driver's buffer bounds a frame.
+size_t sim_rmt_receive(rmt_channel_t channel, const sim_edge_t* edges, size_t count) {
+    _sim_rmt_channel_t* rmt = &_sim_rmt[channel];
+    rmt_item32_t* items = _sim_rmt_rx_items[channel];
+    size_t max = rmt->rx_buf_size / sizeof (rmt_item32_t);
+    int64_t source_ps = 1000000000000LL / rmt->source_hz;
+    int64_t tick_ps = rmt->config.clk_div * source_ps;
+    int64_t filter_ps = rmt->config.rx_config.filter_en ? rmt->config.rx_config.filter_ticks_thresh * source_ps : 0;
+    size_t half = 0;
+
+    max = max < SIM_RMT_RX_ITEMS_MAX ? max : SIM_RMT_RX_ITEMS_MAX;
+    memset(items, 0, sizeof _sim_rmt_rx_items[channel]);
+
+    if (!count) {
+        return 0;
+    }
+
+    int64_t start_ps = edges[0].at_ps;
+    uint8_t level = edges[0].level;
+
+    // the level after the final edge is idle and ends the frame
+    for (size_t i = 1; i < count && half / 2 < max; i++) {
+        if (edges[i].level == level) {
+            continue;
+        }
+
+        if (i + 1 < count && edges[i + 1].at_ps - edges[i].at_ps < filter_ps) {
+            i++; // glitch, the level before it carries on
+            continue;
+        }
+
+        uint32_t ticks = edges[i].at_ps / tick_ps - start_ps / tick_ps;
+        if (ticks > rmt->config.rx_config.idle_threshold) {
+            break;
+        }
+
+        rmt_item32_t* item = &items[half / 2];
+        if (half % 2 == 0) {
+            item->duration0 = ticks;
+            item->level0 = !level;
+        } else {
+            item->duration1 = ticks;
+            item->level1 = !level;
+        }
+
+        half++;
+        start_ps = edges[i].at_ps;
+        level = edges[i].level;
+    }
+
+    rmt->rx_count = (half + 1) / 2;
+    rmt->rx_pending = rmt->rx_count > 0;
+
+    return rmt->rx_count;
+}
+
+void* xRingbufferReceive(RingbufHandle_t ringbuf, size_t* size, TickType_t ticks) {
+    _sim_rmt_channel_t* rmt = ringbuf;
+
+    if (!rmt || !rmt->rx_pending) {
+        vTaskDelay(ticks);
+        return NULL;
+    }
+
+    *size = rmt->rx_count * sizeof (rmt_item32_t);
+    return _sim_rmt_rx_items[rmt - _sim_rmt];
+}
+
+void vRingbufferReturnItem(RingbufHandle_t ringbuf, void* item) {
+    _sim_rmt_channel_t* rmt = ringbuf;
+
+    rmt->rx_pending = false;
+}
+
+bool sim_ir_frame(const sim_edge_t* edges, size_t count, sim_ir_frame_t* frame) {
+    int64_t mark_start = -1;
+    int64_t last_rise = -1;
+    int64_t last_fall = -1;
+    int64_t periods_ps = 0;
+    int64_t highs_ps = 0;
+    uint32_t periods = 0;
+
+    memset(frame, 0, sizeof *frame);
+
+    for (size_t i = 0; i < count; i++) {
+        const sim_edge_t* edge = &edges[i];
+
+        if (edge->level) {
+            if (mark_start >= 0 && edge->at_ps - last_fall > SIM_IR_SPACE_MIN_US * 1000000LL) {
+                // the low period was a space, the previous mark ended on its last fall
+                if (frame->count + 2 > SIM_IR_MAX_DURATIONS) {
+                    return false;
+                }
+                frame->durations_us[frame->count++] = (last_fall - mark_start) / 1e6;
+                frame->durations_us[frame->count++] = (edge->at_ps - last_fall) / 1e6;
+                mark_start = -1;
+            }
+
+            if (mark_start < 0) {
+                mark_start = edge->at_ps;
+            } else {
+                int64_t period = edge->at_ps - last_rise;
+                frame->min_period_ps = !periods || period < frame->min_period_ps ? period : frame->min_period_ps;
+                frame->max_period_ps = period > frame->max_period_ps ? period : frame->max_period_ps;
+                periods_ps += period;
+                highs_ps += last_fall - last_rise;
+                periods++;
+            }
+
+            last_rise = edge->at_ps;
+        } else if (last_rise >= 0) {
+            last_fall = edge->at_ps;
+        }
+    }
+
+    if (mark_start >= 0 && last_fall > mark_start) {
+        if (frame->count + 1 > SIM_IR_MAX_DURATIONS) {
+            return false;
+        }
+        frame->durations_us[frame->count++] = (last_fall - mark_start) / 1e6;
+    }
+
+    if (periods) {
+        frame->carrier_hz = 1e12 * periods / periods_ps;
+        frame->duty_percent = 100.0 * highs_ps / periods_ps;
+    }
+
+    return frame->count > 0;
+}
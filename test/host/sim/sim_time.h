@@ -0,0 +1,15 @@
+#include <sys/time.h>
+
+#ifndef SIM_TIME_H
+#define SIM_TIME_H
+
+// Force included into every host build so the firmware's wall clock follows
+// the virtual clock instead of the host's.
+
+int sim_gettimeofday(struct timeval* tv, void* tz);
+int sim_settimeofday(const struct timeval* tv, const void* tz);
+
+#define gettimeofday sim_gettimeofday
+#define settimeofday sim_settimeofday
+
+#endif // SIM_TIME_H
@@ -0,0 +1,72 @@
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <driver/uart.h>
+
+#include "sim.h"
+
+static int _sim_uart_fd[UART_NUM_MAX] = { -1, -1, -1 };
+
+void sim_uart_attach(uart_port_t port, int fd) {
+    _sim_uart_fd[port] = fd;
+}
+
+esp_err_t uart_driver_install(uart_port_t port, int rx_buffer_size, int tx_buffer_size, int queue_size,
+    void* uart_queue, int intr_alloc_flags) {
+    return ESP_OK;
+}
+
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t* config) {
+    return ESP_OK;
+}
+
+esp_err_t uart_set_pin(uart_port_t port, int tx, int rx, int rts, int cts) {
+    return ESP_OK;
+}
+
+// Ticks are milliseconds, portMAX_DELAY blocks until there is data.
+int uart_read_bytes(uart_port_t port, void* buf, uint32_t length, TickType_t ticks_to_wait) {
+    int fd = _sim_uart_fd[port];
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    if (poll(&pfd, 1, ticks_to_wait == portMAX_DELAY ? -1 : (int) ticks_to_wait) <= 0) {
+        return 0;
+    }
+
+    // a driver read returns once length bytes arrived or the wait is over
+    size_t received = 0;
+    while (received < length) {
+        ssize_t n = read(fd, (uint8_t*) buf + received, length - received);
+        if (n <= 0) {
+            break;
+        }
+        received += n;
+
+        if (received < length && poll(&pfd, 1, ticks_to_wait == portMAX_DELAY ? -1 : (int) ticks_to_wait) <= 0) {
+            break;
+        }
+    }
+
+    return received;
+}
+
+int uart_write_bytes(uart_port_t port, const void* src, size_t size) {
+    int fd = _sim_uart_fd[port];
+
+    return fd < 0 ? -1 : write(fd, src, size);
+}
+
+esp_err_t uart_get_buffered_data_len(uart_port_t port, size_t* size) {
+    int available = 0;
+
+    if (_sim_uart_fd[port] < 0 || ioctl(_sim_uart_fd[port], FIONREAD, &available) != 0) {
+        return ESP_FAIL;
+    }
+
+    *size = available;
+
+    return ESP_OK;
+}
@@ -0,0 +1,6 @@
+#ifndef DRIVER_GPIO_H
+#define DRIVER_GPIO_H
+
+typedef int gpio_num_t;
+
+#endif // DRIVER_GPIO_H
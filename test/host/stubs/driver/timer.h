@@ -0,0 +1,4 @@
+#ifndef DRIVER_TIMER_H
+#define DRIVER_TIMER_H
+
+#endif // DRIVER_TIMER_H
@@ -0,0 +1,33 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+#ifndef ESP_HEAP_TRACE_H
+#define ESP_HEAP_TRACE_H
+
+// Host stand-in for standalone heap tracing. The simulator records only the
+// allocations a test reports with sim_heap_alloc.
+
+typedef enum {
+    HEAP_TRACE_ALL,
+    HEAP_TRACE_LEAKS,
+} heap_trace_mode_t;
+
+typedef struct {
+    uint32_t ccount;
+    void* address;
+    size_t size;
+    void* alloced_by[CONFIG_HEAP_TRACING_STACK_DEPTH];
+    void* freed_by[CONFIG_HEAP_TRACING_STACK_DEPTH];
+} heap_trace_record_t;
+
+esp_err_t heap_trace_init_standalone(heap_trace_record_t* record_buffer, size_t num_records);
+esp_err_t heap_trace_start(heap_trace_mode_t mode);
+esp_err_t heap_trace_stop(void);
+size_t heap_trace_get_count(void);
+esp_err_t heap_trace_get(size_t index, heap_trace_record_t* record);
+
+#endif // ESP_HEAP_TRACE_H
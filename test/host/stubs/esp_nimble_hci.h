@@ -0,0 +1,8 @@
+#include "esp_err.h"
+
+#ifndef ESP_NIMBLE_HCI_H
+#define ESP_NIMBLE_HCI_H
+
+esp_err_t esp_nimble_hci_and_controller_init(void);
+
+#endif // ESP_NIMBLE_HCI_H
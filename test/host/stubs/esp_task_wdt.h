@@ -0,0 +1,11 @@
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#ifndef ESP_TASK_WDT_H
+#define ESP_TASK_WDT_H
+
+esp_err_t esp_task_wdt_add(TaskHandle_t handle);
+esp_err_t esp_task_wdt_reset(void);
+
+#endif // ESP_TASK_WDT_H
@@ -0,0 +1,34 @@
+#include <stdint.h>
+
+#ifndef FREERTOS_H
+#define FREERTOS_H
+
+// Host stand-in. Ticks are milliseconds of the virtual clock in sim.h.
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint8_t StackType_t;
+
+#define pdTRUE (1)
+#define pdFALSE (0)
+#define pdPASS (1)
+
+#define portMAX_DELAY ((TickType_t) 0xFFFFFFFF)
+#define portTICK_PERIOD_MS (1)
+#define pdMS_TO_TICKS(ms) ((TickType_t) (ms))
+
+typedef struct {
+    int unused;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED { 0 }
+
+// the firmware only uses critical sections for short ring updates
+void sim_enter_critical(portMUX_TYPE* mux);
+void sim_exit_critical(portMUX_TYPE* mux);
+
+#define portENTER_CRITICAL(mux) sim_enter_critical(mux)
+#define portEXIT_CRITICAL(mux) sim_exit_critical(mux)
+
+#endif // FREERTOS_H
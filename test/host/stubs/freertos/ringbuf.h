@@ -0,0 +1,13 @@
+#include <stddef.h>
+
+#include "FreeRTOS.h"
+
+#ifndef FREERTOS_RINGBUF_H
+#define FREERTOS_RINGBUF_H
+
+typedef void* RingbufHandle_t;
+
+void* xRingbufferReceive(RingbufHandle_t ringbuf, size_t* size, TickType_t ticks);
+void vRingbufferReturnItem(RingbufHandle_t ringbuf, void* item);
+
+#endif // FREERTOS_RINGBUF_H
@@ -0,0 +1,31 @@
+#include "FreeRTOS.h"
+
+#ifndef FREERTOS_TASK_H
+#define FREERTOS_TASK_H
+
+typedef void (*TaskFunction_t)(void* param);
+
+// Task control block. Tasks are recorded, not run, unless a test starts one
+// on a host thread with sim_task_start.
+typedef struct {
+    TaskFunction_t function;
+    void* param;
+    const char* name;
+    void* thread;
+    uint32_t notified;
+} StaticTask_t;
+
+typedef StaticTask_t* TaskHandle_t;
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t function, const char* name, uint32_t stack_depth, void* param,
+    UBaseType_t priority, StackType_t* stack, StaticTask_t* task);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetHandle(const char* name);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks);
+
+#endif // FREERTOS_TASK_H
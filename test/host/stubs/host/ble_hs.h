@@ -0,0 +1,362 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ble_uuid.h"
+
+#ifndef H_BLE_HS_
+#define H_BLE_HS_
+
+// Host stand-in for the parts of the NimBLE host the firmware uses. GAP
+// calls are recorded for tests, see sim.h, and mbufs come from a static pool.
+
+#define MYNEWT_VAL(name) MYNEWT_VAL_##name
+#define MYNEWT_VAL_BLE_EXT_ADV (1)
+
+/// mbufs
+
+struct os_mbuf {
+    uint16_t om_len;
+    uint16_t om_size;
+    uint8_t om_data[256];
+    bool in_use;
+};
+
+#define OS_MBUF_PKTLEN(om) ((om)->om_len)
+
+struct os_mbuf* os_msys_get_pkthdr(uint16_t dsize, uint16_t user_hdr_len);
+int os_mbuf_append(struct os_mbuf* om, const void* data, uint16_t len);
+int os_mbuf_free_chain(struct os_mbuf* om);
+int ble_hs_mbuf_to_flat(const struct os_mbuf* om, void* flat, uint16_t max_len, uint16_t* out_copy_len);
+
+/// errors
+
+#define BLE_HS_EAGAIN (1)
+#define BLE_HS_EALREADY (2)
+#define BLE_HS_EINVAL (3)
+#define BLE_HS_EMSGSIZE (4)
+#define BLE_HS_ENOENT (5)
+#define BLE_HS_ENOMEM (6)
+#define BLE_HS_ENOTCONN (7)
+#define BLE_HS_ENOTSUP (8)
+#define BLE_HS_EAPP (9)
+#define BLE_HS_EBADDATA (10)
+#define BLE_HS_EOS (11)
+#define BLE_HS_ECONTROLLER (12)
+#define BLE_HS_ETIMEOUT (13)
+#define BLE_HS_EDONE (14)
+#define BLE_HS_EBUSY (15)
+#define BLE_HS_EREJECT (16)
+#define BLE_HS_EUNKNOWN (17)
+#define BLE_HS_EROLE (18)
+#define BLE_HS_ETIMEOUT_HCI (19)
+#define BLE_HS_ENOMEM_EVT (20)
+#define BLE_HS_ENOADDR (21)
+#define BLE_HS_ENOTSYNCED (22)
+#define BLE_HS_EAUTHEN (23)
+#define BLE_HS_EAUTHOR (24)
+#define BLE_HS_EENCRYPT (25)
+#define BLE_HS_EENCRYPT_KEY_SZ (26)
+#define BLE_HS_ESTORE_CAP (27)
+#define BLE_HS_ESTORE_FAIL (28)
+#define BLE_HS_EPREEMPTED (29)
+#define BLE_HS_EDISABLED (30)
+#define BLE_HS_ESTALLED (31)
+
+#define BLE_ATT_ERR_INVALID_HANDLE (0x01)
+#define BLE_ATT_ERR_WRITE_NOT_PERMITTED (0x03)
+#define BLE_ATT_ERR_UNLIKELY (0x0e)
+#define BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN (0x0d)
+#define BLE_ATT_ERR_INSUFFICIENT_RES (0x11)
+#define BLE_ATT_ERR_VALUE_NOT_ALLOWED (0x13)
+
+#define BLE_HS_CONN_HANDLE_NONE (0xffff)
+#define BLE_HS_FOREVER (INT32_MAX)
+
+/// addresses
+
+#define BLE_ADDR_PUBLIC (0x00)
+#define BLE_ADDR_RANDOM (0x01)
+#define BLE_ADDR_PUBLIC_ID (0x02)
+#define BLE_ADDR_RANDOM_ID (0x03)
+
+#define BLE_OWN_ADDR_PUBLIC (0x00)
+#define BLE_OWN_ADDR_RANDOM (0x01)
+#define BLE_OWN_ADDR_RPA_PUBLIC_DEFAULT (0x02)
+#define BLE_OWN_ADDR_RPA_RANDOM_DEFAULT (0x03)
+
+typedef struct {
+    uint8_t type;
+    uint8_t val[6];
+} ble_addr_t;
+
+int ble_hs_synced(void);
+int ble_hs_id_infer_auto(int privacy, uint8_t* out_addr_type);
+int ble_hs_id_copy_addr(uint8_t id_addr_type, uint8_t* out_id_addr, int* out_is_nrpa);
+
+/// GATT server
+
+#define BLE_GATT_SVC_TYPE_END (0)
+#define BLE_GATT_SVC_TYPE_PRIMARY (1)
+
+#define BLE_GATT_CHR_F_READ (0x0002)
+#define BLE_GATT_CHR_F_WRITE (0x0008)
+
+#define BLE_GATT_ACCESS_OP_READ_CHR (0)
+#define BLE_GATT_ACCESS_OP_WRITE_CHR (1)
+
+struct ble_gatt_access_ctxt;
+
+typedef int ble_gatt_access_fn(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt* ctxt, void* arg);
+
+struct ble_gatt_chr_def {
+    const ble_uuid_t* uuid;
+    ble_gatt_access_fn* access_cb;
+    void* arg;
+    void* descriptors;
+    uint16_t flags;
+    uint8_t min_key_size;
+    uint16_t* val_handle;
+};
+
+struct ble_gatt_svc_def {
+    uint8_t type;
+    const ble_uuid_t* uuid;
+    const struct ble_gatt_svc_def** includes;
+    const struct ble_gatt_chr_def* characteristics;
+};
+
+struct ble_gatt_access_ctxt {
+    uint8_t op;
+    struct os_mbuf* om;
+    union {
+        const struct ble_gatt_chr_def* chr;
+        const void* dsc;
+    };
+};
+
+int ble_gatts_count_cfg(const struct ble_gatt_svc_def* defs);
+int ble_gatts_add_svcs(const struct ble_gatt_svc_def* svcs);
+
+/// GAP
+
+#define BLE_HCI_LE_PHY_1M (1)
+#define BLE_HCI_LE_PHY_2M (2)
+#define BLE_HCI_LE_PHY_CODED (3)
+
+#define BLE_GAP_LE_PHY_1M_MASK (0x01)
+#define BLE_GAP_LE_PHY_2M_MASK (0x02)
+#define BLE_GAP_LE_PHY_CODED_MASK (0x04)
+#define BLE_GAP_LE_PHY_CODED_ANY (0)
+#define BLE_GAP_LE_PHY_CODED_S2 (1)
+#define BLE_GAP_LE_PHY_CODED_S8 (2)
+
+/// 0.625 ms units
+#define BLE_GAP_ADV_FAST_INTERVAL1_MIN (48)
+#define BLE_GAP_ADV_FAST_INTERVAL1_MAX (96)
+#define BLE_GAP_ADV_FAST_INTERVAL2_MIN (160)
+#define BLE_GAP_ADV_FAST_INTERVAL2_MAX (240)
+
+#define BLE_GAP_CONN_MODE_NON (0)
+#define BLE_GAP_CONN_MODE_DIR (1)
+#define BLE_GAP_CONN_MODE_UND (2)
+
+#define BLE_GAP_DISC_MODE_NON (0)
+#define BLE_GAP_DISC_MODE_LTD (1)
+#define BLE_GAP_DISC_MODE_GEN (2)
+
+#define BLE_GAP_EVENT_CONNECT (0)
+#define BLE_GAP_EVENT_DISCONNECT (1)
+#define BLE_GAP_EVENT_CONN_UPDATE (3)
+#define BLE_GAP_EVENT_CONN_UPDATE_REQ (4)
+#define BLE_GAP_EVENT_L2CAP_UPDATE_REQ (5)
+#define BLE_GAP_EVENT_TERM_FAILURE (6)
+#define BLE_GAP_EVENT_DISC (7)
+#define BLE_GAP_EVENT_DISC_COMPLETE (8)
+#define BLE_GAP_EVENT_ADV_COMPLETE (9)
+#define BLE_GAP_EVENT_ENC_CHANGE (10)
+#define BLE_GAP_EVENT_PASSKEY_ACTION (11)
+#define BLE_GAP_EVENT_NOTIFY_RX (12)
+#define BLE_GAP_EVENT_NOTIFY_TX (13)
+#define BLE_GAP_EVENT_SUBSCRIBE (14)
+#define BLE_GAP_EVENT_MTU (15)
+#define BLE_GAP_EVENT_IDENTITY_RESOLVED (16)
+#define BLE_GAP_EVENT_REPEAT_PAIRING (17)
+#define BLE_GAP_EVENT_PHY_UPDATE_COMPLETE (18)
+#define BLE_GAP_EVENT_EXT_DISC (19)
+#define BLE_GAP_EVENT_PERIODIC_SYNC (20)
+#define BLE_GAP_EVENT_PERIODIC_REPORT (21)
+#define BLE_GAP_EVENT_PERIODIC_SYNC_LOST (22)
+#define BLE_GAP_EVENT_SCAN_REQ_RCVD (23)
+#define BLE_GAP_EVENT_PERIODIC_TRANSFER (24)
+
+#define BLE_GAP_REPEAT_PAIRING_RETRY (1)
+#define BLE_GAP_REPEAT_PAIRING_IGNORE (2)
+
+struct ble_gap_sec_state {
+    unsigned encrypted : 1;
+    unsigned authenticated : 1;
+    unsigned bonded : 1;
+    unsigned key_size : 5;
+};
+
+struct ble_gap_conn_desc {
+    struct ble_gap_sec_state sec_state;
+    ble_addr_t our_id_addr;
+    ble_addr_t our_ota_addr;
+    ble_addr_t peer_id_addr;
+    ble_addr_t peer_ota_addr;
+    uint16_t conn_handle;
+    uint16_t conn_itvl;
+    uint16_t conn_latency;
+    uint16_t supervision_timeout;
+    uint8_t role;
+    uint8_t master_clock_accuracy;
+};
+
+struct ble_gap_event {
+    uint8_t type;
+    union {
+        struct {
+            int status;
+            uint16_t conn_handle;
+        } connect;
+        struct {
+            int reason;
+            struct ble_gap_conn_desc conn;
+        } disconnect;
+        struct {
+            int status;
+            uint16_t conn_handle;
+        } conn_update;
+        struct {
+            int reason;
+            uint8_t instance;
+            uint16_t conn_handle;
+            uint8_t num_ext_adv_events;
+        } adv_complete;
+        struct {
+            int status;
+            uint16_t conn_handle;
+        } enc_change;
+        struct {
+            uint16_t conn_handle;
+            uint8_t cur_key_size;
+            uint8_t cur_authenticated : 1;
+            uint8_t cur_sc : 1;
+            uint8_t new_key_size;
+            uint8_t new_authenticated : 1;
+            uint8_t new_sc : 1;
+            uint8_t new_bonding : 1;
+        } repeat_pairing;
+        struct {
+            int status;
+            uint16_t conn_handle;
+            uint8_t tx_phy;
+            uint8_t rx_phy;
+        } phy_updated;
+        struct {
+            uint16_t conn_handle;
+            uint16_t channel_id;
+            uint16_t value;
+        } mtu;
+    };
+};
+
+typedef int ble_gap_event_fn(struct ble_gap_event* event, void* arg);
+
+struct ble_gap_adv_params {
+    uint8_t conn_mode;
+    uint8_t disc_mode;
+    uint16_t itvl_min;
+    uint16_t itvl_max;
+    uint8_t channel_map;
+    uint8_t filter_policy;
+    uint8_t high_duty_cycle : 1;
+};
+
+struct ble_gap_ext_adv_params {
+    unsigned int connectable : 1;
+    unsigned int scannable : 1;
+    unsigned int directed : 1;
+    unsigned int high_duty_directed : 1;
+    unsigned int legacy_pdu : 1;
+    unsigned int anonymous : 1;
+    unsigned int include_tx_power : 1;
+    unsigned int scan_req_notif : 1;
+    uint32_t itvl_min;
+    uint32_t itvl_max;
+    uint8_t channel_map;
+    uint8_t own_addr_type;
+    ble_addr_t peer;
+    uint8_t filter_policy;
+    uint8_t primary_phy;
+    uint8_t secondary_phy;
+    int8_t tx_power;
+    uint8_t sid;
+};
+
+struct ble_hs_adv_fields {
+    const uint8_t* name;
+    uint8_t name_len;
+    unsigned name_is_complete : 1;
+};
+
+#define BLE_HS_ADV_MAX_SZ (31)
+
+int ble_hs_adv_set_fields_mbuf(const struct ble_hs_adv_fields* adv_fields, struct os_mbuf* om);
+
+int ble_gap_adv_set_fields(const struct ble_hs_adv_fields* adv_fields);
+int ble_gap_adv_start(uint8_t own_addr_type, const ble_addr_t* direct_addr, int32_t duration_ms,
+    const struct ble_gap_adv_params* adv_params, ble_gap_event_fn* cb, void* cb_arg);
+int ble_gap_adv_stop(void);
+int ble_gap_adv_active(void);
+
+int ble_gap_ext_adv_configure(uint8_t instance, const struct ble_gap_ext_adv_params* params, int8_t* selected_tx_power,
+    ble_gap_event_fn* cb, void* cb_arg);
+int ble_gap_ext_adv_set_data(uint8_t instance, struct os_mbuf* data);
+int ble_gap_ext_adv_start(uint8_t instance, int duration, int max_events);
+int ble_gap_ext_adv_stop(uint8_t instance);
+bool ble_gap_ext_adv_active(uint8_t instance);
+
+int ble_gap_conn_find(uint16_t handle, struct ble_gap_conn_desc* out_desc);
+int ble_gap_conn_rssi(uint16_t conn_handle, int8_t* out_rssi);
+int ble_gap_security_initiate(uint16_t conn_handle);
+int ble_gap_read_le_phy(uint16_t conn_handle, uint8_t* tx_phy, uint8_t* rx_phy);
+int ble_gap_set_prefered_le_phy(uint16_t conn_handle, uint8_t tx_phys_mask, uint8_t rx_phys_mask, uint16_t phy_opts);
+
+/// security manager and store
+
+#define BLE_SM_IO_CAP_DISP_ONLY (0x00)
+#define BLE_SM_IO_CAP_NO_IO (0x03)
+
+#define BLE_SM_PAIR_KEY_DIST_ENC (0x01)
+#define BLE_SM_PAIR_KEY_DIST_ID (0x02)
+
+struct ble_store_status_event;
+
+int ble_store_util_delete_peer(const ble_addr_t* peer_id_addr);
+int ble_store_util_status_rr(struct ble_store_status_event* event, void* arg);
+
+typedef void ble_hs_reset_fn(int reason);
+typedef void ble_hs_sync_fn(void);
+typedef int ble_store_status_fn(struct ble_store_status_event* event, void* arg);
+
+struct ble_hs_cfg {
+    ble_hs_reset_fn* reset_cb;
+    ble_hs_sync_fn* sync_cb;
+    ble_store_status_fn* store_status_cb;
+    void* store_status_arg;
+    uint8_t sm_io_cap;
+    unsigned sm_oob_data_flag : 1;
+    unsigned sm_bonding : 1;
+    unsigned sm_mitm : 1;
+    unsigned sm_sc : 1;
+    unsigned sm_keypress : 1;
+    uint8_t sm_our_key_dist;
+    uint8_t sm_their_key_dist;
+};
+
+extern struct ble_hs_cfg ble_hs_cfg;
+
+#endif // H_BLE_HS_
@@ -0,0 +1,21 @@
+#include <stdint.h>
+
+#ifndef H_BLE_UUID_
+#define H_BLE_UUID_
+
+#define BLE_UUID_TYPE_16 (16)
+#define BLE_UUID_TYPE_32 (32)
+#define BLE_UUID_TYPE_128 (128)
+
+typedef struct {
+    uint8_t type;
+} ble_uuid_t;
+
+typedef struct {
+    ble_uuid_t u;
+    uint8_t value[16];
+} ble_uuid128_t;
+
+#define BLE_UUID128(u) ((const ble_uuid128_t *) (u))
+
+#endif // H_BLE_UUID_
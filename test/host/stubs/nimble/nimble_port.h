@@ -0,0 +1,7 @@
+#ifndef _NIMBLE_PORT_H
+#define _NIMBLE_PORT_H
+
+void nimble_port_init(void);
+void nimble_port_run(void);
+
+#endif // _NIMBLE_PORT_H
@@ -0,0 +1,9 @@
+#include "freertos/task.h"
+
+#ifndef _NIMBLE_PORT_FREERTOS_H
+#define _NIMBLE_PORT_FREERTOS_H
+
+void nimble_port_freertos_init(TaskFunction_t host_task_fn);
+void nimble_port_freertos_deinit(void);
+
+#endif // _NIMBLE_PORT_FREERTOS_H
@@ -0,0 +1,11 @@
+// Host stand-in for the generated sdkconfig.h, only what the firmware reads.
+#ifndef SDKCONFIG_H
+#define SDKCONFIG_H
+
+#define CONFIG_ESP32S3_DEFAULT_CPU_FREQ_MHZ 240
+#define CONFIG_PM_ENABLE 1
+#define CONFIG_PM_PROFILING 1
+#define CONFIG_HEAP_TRACING_STANDALONE 1
+#define CONFIG_HEAP_TRACING_STACK_DEPTH 2
+
+#endif // SDKCONFIG_H
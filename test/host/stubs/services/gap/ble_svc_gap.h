@@ -0,0 +1,7 @@
+#ifndef H_BLE_SVC_GAP_
+#define H_BLE_SVC_GAP_
+
+void ble_svc_gap_init(void);
+int ble_svc_gap_device_name_set(const char* name);
+
+#endif // H_BLE_SVC_GAP_
@@ -0,0 +1,9 @@
+#include <stdint.h>
+
+#ifndef H_BLE_SVC_GATT_
+#define H_BLE_SVC_GATT_
+
+void ble_svc_gatt_init(void);
+void ble_svc_gatt_changed(uint16_t start_handle, uint16_t end_handle);
+
+#endif // H_BLE_SVC_GATT_
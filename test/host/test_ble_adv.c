@@ -0,0 +1,54 @@
+#include <assert.h>
+#include <stdio.h>
+
+#include "sim.h"
+
+#include "nir_ble.h"
+
+// Advertising asks for an explicit TX power on every instance. The fake
+// controller, like the real one, takes 127 as no preference and picks its
+// default, anything else is clamped to what the S3 supports.
+
+void _nir_ext_adv_params(uint8_t instance, struct ble_gap_ext_adv_params* params);
+
+static void _test_params(void) {
+    struct ble_gap_ext_adv_params params;
+
+    for (uint8_t instance = NIR_ADV_INSTANCE_1M; instance <= NIR_ADV_INSTANCE_CODED; instance++) {
+        _nir_ext_adv_params(instance, &params);
+        assert(params.tx_power == NIR_ADV_TX_POWER);
+    }
+}
+
+static void _test_selected(void) {
+    for (uint8_t instance = NIR_ADV_INSTANCE_1M; instance <= NIR_ADV_INSTANCE_CODED; instance++) {
+        const sim_adv_t* adv = sim_ble_adv(instance);
+
+        printf("instance %u: %d dBm\n", instance, adv->selected_tx_power);
+        assert(adv->active);
+        assert(adv->selected_tx_power == NIR_ADV_TX_POWER);
+    }
+}
+
+static void _test_directed(void) {
+    const ble_addr_t peer = { .type = BLE_ADDR_PUBLIC, .val = { 1, 2, 3, 4, 5, 6 } };
+
+    sim_ble_connect(1, &peer, true);
+    sim_ble_disconnect(0x213); // remote user terminated
+
+    const sim_adv_t* adv = sim_ble_adv(NIR_ADV_INSTANCE_1M);
+    printf("directed: %d dBm\n", adv->selected_tx_power);
+    assert(adv->active && adv->params.directed);
+    assert(adv->selected_tx_power == NIR_ADV_TX_POWER);
+}
+
+int main(void) {
+    sim_boot();
+
+    _test_params();
+    _test_selected();
+    _test_directed();
+
+    printf("test_ble_adv: pass\n");
+    return 0;
+}
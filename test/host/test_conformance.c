@@ -0,0 +1,131 @@
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sim.h"
+
+#include "nikon_ir_remote.h"
+#include "nir_code.h"
+#include "nir_timer.h"
+
+// The LED output of every built in protocol, as the RMT model clocks it out,
+// against the protocol's carrier, duty and per duration tolerances. Replaces
+// checking the encoded items against the code they were encoded from.
+
+#define EDGES_MAX (20000)
+
+static sim_edge_t _edges[EDGES_MAX];
+
+static void _shoot(sim_ir_frame_t* frame) {
+    sim_rmt_capture(_edges, EDGES_MAX);
+
+    nir_timer_start_burst(1, NULL);
+    sim_run_for(1000000);
+
+    assert(sim_rmt_captured() < EDGES_MAX);
+    assert(sim_ir_frame(_edges, sim_rmt_captured(), frame));
+}
+
+static bool _conforms(const nir_code_t* code, const sim_ir_frame_t* frame, uint32_t carrier_hz, uint8_t duty) {
+    bool conforms = true;
+
+    printf("%s: %.1f Hz %.2f%%, %u durations\n", code->name, frame->carrier_hz, frame->duty_percent, frame->count);
+
+    // carrier against what was asked for and against the protocol
+    if (fabs(frame->carrier_hz - carrier_hz) > code->carrier_tolerance_hz ||
+        fabs(frame->carrier_hz - code->carrier_hz) > code->carrier_tolerance_hz) {
+        printf("  carrier: %.1f Hz, expected: %u +/- %u Hz\n", frame->carrier_hz, code->carrier_hz,
+            code->carrier_tolerance_hz);
+        conforms = false;
+    }
+
+    if (fabs(frame->duty_percent - duty) > code->duty_tolerance_percent ||
+        fabs(frame->duty_percent - code->duty_percent) > code->duty_tolerance_percent) {
+        printf("  duty: %.2f%%, expected: %u +/- %u%%\n", frame->duty_percent, code->duty_percent,
+            code->duty_tolerance_percent);
+        conforms = false;
+    }
+
+    // a steady carrier, every period the same whole number of source clock cycles
+    if (frame->max_period_ps != frame->min_period_ps) {
+        printf("  carrier period: %lld to %lld ps\n", (long long) frame->min_period_ps,
+            (long long) frame->max_period_ps);
+        conforms = false;
+    }
+
+    if (frame->count != code->count) {
+        printf("  durations: %u, expected: %u\n", frame->count, code->count);
+        return false;
+    }
+
+    for (uint16_t i = 0; i < code->count; i++) {
+        if (fabs(frame->durations_us[i] - code->durations[i]) > code->duration_tolerance_us) {
+            printf("  %s %u: %.2f us, expected: %u +/- %u us\n", i % 2 == 0 ? "mark" : "space", i,
+                frame->durations_us[i], code->durations[i], code->duration_tolerance_us);
+            conforms = false;
+        }
+    }
+
+    return conforms;
+}
+
+static void _test_protocols(void) {
+    for (uint16_t protocol = 0; protocol < NIR_CODES_BUILTIN; protocol++) {
+        const nir_code_t* code = nir_code_get(protocol);
+        sim_ir_frame_t frame;
+
+        nir_set_protocol(protocol);
+        nir_set_carrierhz(code->carrier_hz);
+        nir_set_duty(code->duty_percent);
+
+        _shoot(&frame);
+        assert(_conforms(code, &frame, code->carrier_hz, code->duty_percent));
+    }
+}
+
+// A carrier change while a frame is clocking out applies from the next frame.
+static void _test_carrier_between_frames(void) {
+    const nir_code_t* code = nir_code_get(0);
+    sim_ir_frame_t frame;
+
+    nir_set_protocol(0);
+    nir_set_carrierhz(code->carrier_hz);
+    nir_set_duty(code->duty_percent);
+
+    uint32_t disturbed = sim_rmt_disturbed();
+
+    sim_rmt_capture(_edges, EDGES_MAX);
+    nir_timer_start_burst(2, NULL);
+    sim_run_for(1000);
+    nir_set_carrierhz(code->carrier_hz + 500);
+    nir_set_duty(code->duty_percent + 5);
+
+    // the first frame finishes on the carrier it started with
+    sim_run_for(nir_code_duration_us(code) + 1000);
+    assert(sim_ir_frame(_edges, sim_rmt_captured(), &frame));
+    assert(_conforms(code, &frame, code->carrier_hz, code->duty_percent));
+
+    sim_rmt_capture(_edges, EDGES_MAX);
+    sim_run_for(1000000);
+    assert(sim_ir_frame(_edges, sim_rmt_captured(), &frame));
+    assert(_conforms(code, &frame, code->carrier_hz + 500, code->duty_percent + 5));
+
+    assert(sim_rmt_disturbed() == disturbed);
+}
+
+int main(void) {
+    sim_boot();
+
+    // DFS can scale APB while the RMT runs from XTAL, and nothing holds APB while idle
+    assert(sim_rmt_source_hz(RMT_CHANNEL_0) == 40000000);
+    assert(sim_pm_held(ESP_PM_APB_FREQ_MAX) == 0);
+
+    _test_protocols();
+    _test_carrier_between_frames();
+
+    assert(sim_rmt_overlaps() == 0);
+
+    printf("test_conformance: pass\n");
+    return 0;
+}
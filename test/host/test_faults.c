@@ -0,0 +1,180 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sim.h"
+
+#include "nikon_ir_remote.h"
+#include "nir_ble.h"
+#include "nir_code.h"
+#include "nir_timer.h"
+
+// Faults injected into the simulator while a timelapse runs, measured from
+// the frames the RMT actually clocked out: how late the schedule got and how
+// many shots it lost, against what the firmware counted. One NIR_FAULT JSON
+// object per case.
+
+#define DELAY_US (1000000)
+#define SHOTS (20)
+#define STARTS_MAX (64)
+
+/// what nir_timer_supervise waits past a missed frame, and how often the
+/// control task calls it
+#define SUPERVISE_MARGIN_US (500000)
+#define CONTROL_INTERVAL_US (NIR_CONTROL_INTERVAL_MS * 1000)
+
+static int64_t _starts[STARTS_MAX];
+static esp_timer_handle_t _control_timer;
+static int64_t _period_us;
+
+// stands in for the control task
+static void _control(void* arg) {
+    nir_timer_supervise();
+}
+
+typedef struct {
+    size_t frames;
+    uint32_t missed;
+    uint32_t reported_missed;
+    uint32_t recoveries;
+    int64_t recovery_us;
+} _result_t;
+
+static void _run(const char* fault, void (*inject)(void), _result_t* result) {
+    uint32_t missed = nir_timer_get_missed();
+    uint32_t recoveries = nir_timer_get_recoveries();
+
+    sim_rmt_log_frames(_starts, STARTS_MAX);
+    nir_timer_start(DELAY_US);
+
+    // a few frames on schedule first
+    while (sim_rmt_logged_frames() < 3) {
+        sim_run_for(_period_us / 4);
+    }
+    inject();
+    sim_run_for(SHOTS * _period_us);
+
+    memset(result, 0, sizeof *result);
+    result->frames = sim_rmt_logged_frames();
+    result->reported_missed = nir_timer_get_missed() - missed;
+    result->recoveries = nir_timer_get_recoveries() - recoveries;
+
+    // every slot a frame should have gone out in, against the ones that did
+    for (size_t i = 1; i < result->frames; i++) {
+        int64_t gap = _starts[i] - _starts[i - 1];
+        int64_t late = gap - _period_us;
+
+        result->recovery_us = late > result->recovery_us ? late : result->recovery_us;
+        result->missed += (gap + _period_us / 2) / _period_us - 1;
+    }
+
+    printf("NIR_FAULT {\"fault\":\"%s\",\"frames\":%zu,\"missed\":%u,\"reported_missed\":%u,\"recoveries\":%u,"
+        "\"recovery_us\":%lld}\n", fault, result->frames, result->missed, result->reported_missed,
+        result->recoveries, (long long) result->recovery_us);
+
+    // nothing left awake between frames once recovered
+    int64_t between = _starts[result->frames - 1] + _period_us / 2;
+    sim_run_until(between > sim_now() ? between : between + _period_us);
+    assert(sim_pm_held(ESP_PM_NO_LIGHT_SLEEP) == 0);
+
+    nir_timer_stop();
+}
+
+static void _none(void) {
+}
+
+static void _invalid_state(void) {
+    sim_timer_fail_every("pulse_timer", 3, ESP_ERR_INVALID_STATE);
+}
+
+static void _drop_pulse(void) {
+    sim_timer_drop_next("pulse_timer");
+}
+
+static void _drop_frame_end(void) {
+    sim_timer_drop_next("frame_end_timer");
+}
+
+static void _no_mem(void) {
+    sim_timer_fail_every("pulse_timer", 1, ESP_ERR_NO_MEM);
+    sim_run_for(3 * _period_us);
+    sim_timer_fail_every("pulse_timer", 0, ESP_OK);
+}
+
+static void _test_timer(void) {
+    _result_t result;
+
+    _run("none", _none, &result);
+    assert(result.missed == 0 && result.reported_missed == 0 && result.recoveries == 0);
+    assert(result.recovery_us == 0);
+
+    // re-armed in place, nothing lost
+    _run("invalid_state", _invalid_state, &result);
+    sim_timer_fail_every("pulse_timer", 0, ESP_OK);
+    assert(result.missed == 0 && result.reported_missed == 0);
+    assert(result.recoveries > 0);
+    assert(result.recovery_us == 0);
+
+    // lost callbacks are found by the supervisor, the frame goes out late
+    _run("drop_pulse", _drop_pulse, &result);
+    assert(result.recoveries == 1);
+    assert(result.reported_missed >= result.missed && result.reported_missed <= result.missed + 1);
+    assert(result.recovery_us <= SUPERVISE_MARGIN_US + CONTROL_INTERVAL_US);
+
+    _run("drop_frame_end", _drop_frame_end, &result);
+    assert(result.recoveries == 1);
+    assert(result.reported_missed >= result.missed && result.reported_missed <= result.missed + 1);
+    assert(result.recovery_us <= SUPERVISE_MARGIN_US + CONTROL_INTERVAL_US);
+
+    // arms keep failing for a while, no reboot, back within a control interval of clearing
+    _run("no_mem", _no_mem, &result);
+    assert(result.recoveries > 0);
+    assert(result.reported_missed >= result.missed);
+    assert(result.recovery_us <= 3 * _period_us + SUPERVISE_MARGIN_US + CONTROL_INTERVAL_US);
+
+    assert(sim_rmt_overlaps() == 0);
+}
+
+// advertising that fails to start after a disconnect is retried with backoff
+static void _test_advertising(void) {
+    const ble_addr_t peer = { .type = BLE_ADDR_PUBLIC, .val = { 1, 2, 3, 4, 5, 6 } };
+    uint32_t retries = nir_ble_get_adv_retries();
+
+    sim_ble_connect(1, &peer, false);
+    sim_ble_adv_fail(NIR_ADV_INSTANCE_1M, 3, BLE_HS_ENOMEM);
+
+    int64_t disconnected = sim_now();
+    sim_ble_disconnect(0x213); // remote user terminated
+    sim_run_for(NIR_ADV_RETRY_MAX_US);
+
+    const sim_adv_t* adv = sim_ble_adv(NIR_ADV_INSTANCE_1M);
+    int64_t recovery_us = adv->started_at - disconnected;
+
+    printf("NIR_FAULT {\"fault\":\"adv_start\",\"retries\":%u,\"recovery_us\":%lld}\n",
+        nir_ble_get_adv_retries() - retries, (long long) recovery_us);
+
+    // 100, 200 and 400 ms backoff
+    assert(adv->active);
+    assert(nir_ble_get_adv_retries() - retries == 3);
+    assert(recovery_us == 7 * NIR_ADV_RETRY_MIN_US);
+}
+
+int main(void) {
+    const esp_timer_create_args_t control_args = {
+        .name = "control",
+        .callback = _control,
+    };
+
+    sim_boot();
+
+    ESP_ERROR_CHECK(esp_timer_create(&control_args, &_control_timer));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(_control_timer, CONTROL_INTERVAL_US));
+
+    _period_us = nir_code_duration_us(nir_code_get(0)) + DELAY_US;
+
+    _test_timer();
+    _test_advertising();
+
+    printf("test_faults: pass\n");
+    return 0;
+}
@@ -0,0 +1,153 @@
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "sim.h"
+
+#include "nikon_ir_remote.h"
+#include "nir_code.h"
+#include "nir_learn.h"
+#include "nir_settings.h"
+#include "nir_timer.h"
+
+// A NEC frame through the whole learn path: an ideal 38 kHz LED trace into
+// the RX channel, demodulated, stored as a varint blob, decoded and played
+// back, then the transmitted trace against the original frame.
+
+#define EDGES_MAX (20000)
+
+#define NEC_CARRIER_HZ (38000)
+#define NEC_DUTY_PERCENT (33)
+#define NEC_COUNT (67)
+
+static sim_edge_t _edges[EDGES_MAX];
+
+static int _write(const char* name, uint32_t value) {
+    const nir_setting_t* setting = nir_settings_find(name);
+    uint8_t buffer[sizeof (uint32_t)];
+
+    for (uint16_t i = 0; i < nir_setting_size(setting); i++) {
+        buffer[i] = (value >> (8 * i)) & 0xFF;
+    }
+
+    return sim_ble_gatt_access(1, setting - nir_settings, BLE_GATT_ACCESS_OP_WRITE_CHR, buffer,
+        nir_setting_size(setting), NULL, NULL);
+}
+
+// leader, address 0x00 and command 0x45 each followed by their inverse, stop mark
+static void _nec(uint16_t* durations) {
+    uint32_t data = 0x00 | 0xFF << 8 | 0x45 << 16 | (0x45 ^ 0xFF) << 24;
+    uint16_t n = 0;
+
+    durations[n++] = 9000;
+    durations[n++] = 4500;
+
+    for (uint16_t bit = 0; bit < 32; bit++) {
+        durations[n++] = 560;
+        durations[n++] = data >> bit & 1 ? 1690 : 560;
+    }
+
+    durations[n++] = 560;
+    assert(n == NEC_COUNT);
+}
+
+static size_t _modulate(const uint16_t* durations, uint16_t count) {
+    int64_t period_ps = 1000000000000LL / NEC_CARRIER_HZ;
+    int64_t high_ps = period_ps * NEC_DUTY_PERCENT / 100;
+    int64_t at = 0;
+    size_t n = 0;
+
+    for (uint16_t i = 0; i < count; i++) {
+        int64_t end = at + durations[i] * 1000000LL;
+
+        for (int64_t cycle = at; i % 2 == 0 && cycle < end; cycle += period_ps) {
+            assert(n + 2 <= EDGES_MAX);
+            _edges[n++] = (sim_edge_t) { .at_ps = cycle, .level = 1 };
+            _edges[n++] = (sim_edge_t) { .at_ps = cycle + high_ps < end ? cycle + high_ps : end, .level = 0 };
+        }
+
+        at = end;
+    }
+
+    return n;
+}
+
+static uint16_t _learn(const sim_edge_t* edges, size_t count) {
+    // the frame waits in the ring buffer, the resident task takes it once woken
+    size_t items = sim_rmt_receive(RMT_CHANNEL_4, edges, count);
+    printf("received: %zu items, %zu bytes\n", items, items * sizeof (rmt_item32_t));
+
+    assert(_write("learn", NIR_LEARN_CMD_START) == 0);
+    for (int ms = 0; nir_learn_status() == NIR_LEARN_LISTENING; ms++) {
+        assert(ms < 5000);
+        usleep(1000);
+    }
+
+    return nir_learn_status();
+}
+
+static double _max_error(const uint16_t* expected, const double* durations, uint16_t count) {
+    double max = 0;
+
+    for (uint16_t i = 0; i < count; i++) {
+        double error = fabs(durations[i] - expected[i]);
+        max = error > max ? error : max;
+    }
+
+    return max;
+}
+
+int main(void) {
+    uint16_t nec[NEC_COUNT];
+    double durations[NEC_COUNT];
+
+    sim_boot();
+    assert(sim_task_start("nir_learn"));
+
+    _nec(nec);
+    uint16_t protocol = _learn(_edges, _modulate(nec, NEC_COUNT));
+    assert(protocol == NIR_CODES_BUILTIN);
+
+    // capture, quantise, encode and decode
+    const nir_code_t* learned = nir_code_get(protocol);
+    assert(learned->count == NEC_COUNT);
+    for (uint16_t i = 0; i < NEC_COUNT; i++) {
+        durations[i] = learned->durations[i];
+    }
+
+    double learned_error = _max_error(nec, durations, NEC_COUNT);
+    printf("learned: %u Hz %u%%, max error: %.2f us\n", learned->carrier_hz, learned->duty_percent, learned_error);
+
+    assert(abs((int32_t) learned->carrier_hz - NEC_CARRIER_HZ) <= learned->carrier_tolerance_hz);
+    assert(abs((int32_t) learned->duty_percent - NEC_DUTY_PERCENT) <= learned->duty_tolerance_percent);
+    assert(learned_error <= learned->duration_tolerance_us);
+
+    // played back on its own carrier
+    assert(_write("protocol", protocol) == 0);
+    assert(nir_get_carrierhz() == learned->carrier_hz);
+    assert(nir_get_duty() == learned->duty_percent);
+
+    sim_ir_frame_t frame;
+    sim_rmt_capture(_edges, EDGES_MAX);
+    nir_timer_start_burst(1, NULL);
+    sim_run_for(1000000);
+
+    assert(sim_rmt_captured() < EDGES_MAX);
+    assert(sim_ir_frame(_edges, sim_rmt_captured(), &frame));
+    assert(frame.count == NEC_COUNT);
+
+    double replay_error = _max_error(nec, frame.durations_us, NEC_COUNT);
+    printf("replayed: %.1f Hz %.2f%%, max error: %.2f us\n", frame.carrier_hz, frame.duty_percent, replay_error);
+
+    assert(fabs(frame.carrier_hz - NEC_CARRIER_HZ) <= learned->carrier_tolerance_hz);
+    assert(fabs(frame.duty_percent - NEC_DUTY_PERCENT) <= learned->duty_tolerance_percent);
+    assert(replay_error <= learned->duration_tolerance_us);
+
+    // learning the playback finds the code already stored
+    assert(_learn(_edges, sim_rmt_captured()) == protocol);
+
+    printf("test_learn: pass\n");
+    return 0;
+}
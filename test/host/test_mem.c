@@ -0,0 +1,56 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sim.h"
+
+#include "nir_mem.h"
+#include "nir_settings.h"
+
+// The heap guard reports every allocation heap tracing records after init,
+// freed or not, through the heapallocs characteristic.
+
+static uint32_t _read(const char* name) {
+    const nir_setting_t* setting = nir_settings_find(name);
+    uint8_t buffer[sizeof (uint32_t)] = { 0 };
+    uint16_t len = sizeof buffer;
+    uint32_t value = 0;
+
+    assert(sim_ble_gatt_access(1, setting - nir_settings, BLE_GATT_ACCESS_OP_READ_CHR, NULL, 0, buffer, &len) == 0);
+    for (uint16_t i = 0; i < len; i++) {
+        value |= (uint32_t) buffer[i] << (8 * i);
+    }
+
+    return value;
+}
+
+int main(void) {
+    // before the guard starts nothing is traced
+    sim_heap_alloc(64, main, false);
+
+    sim_boot();
+    assert(sim_timer_active("heap_guard_timer"));
+
+    sim_run_for(NIR_HEAP_GUARD_INTERVAL_US);
+    assert(_read("heapallocs") == 0);
+
+    // a transient allocation counts as much as one that is kept
+    sim_heap_alloc(32, main, true);
+    sim_heap_alloc(48, main, false);
+    sim_run_for(NIR_HEAP_GUARD_INTERVAL_US);
+    assert(_read("heapallocs") == 2);
+
+    // reported ones are cleared for the next interval
+    sim_run_for(NIR_HEAP_GUARD_INTERVAL_US);
+    assert(_read("heapallocs") == 2);
+
+    // a full trace still reports what it holds
+    for (uint16_t i = 0; i < NIR_HEAP_GUARD_RECORDS + 8; i++) {
+        sim_heap_alloc(16, main, true);
+    }
+    sim_run_for(NIR_HEAP_GUARD_INTERVAL_US);
+    assert(_read("heapallocs") == 2 + NIR_HEAP_GUARD_RECORDS);
+
+    printf("test_mem: pass\n");
+    return 0;
+}
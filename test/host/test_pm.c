@@ -0,0 +1,84 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sim.h"
+
+#include "nir_pm.h"
+#include "nir_timer.h"
+
+// nir_pm_parse_stats against the table ESP-IDF 4.4 prints and against the
+// simulator's dump after IR bursts, where the APB_MAX time is known.
+
+static const char* _idf_dump =
+    "Lock stats:\n"
+    "  Name            Type            Arg  Cnt_current  Cnt_total   Time(us)  Time(%)\n"
+    "  rtos0           CPU_FREQ_MAX      0            1       2049    3218712      26%\n"
+    "  nir_ir_apb      APB_FREQ_MAX      0            0         12       4419       0%\n"
+    "Mode stats:\n"
+    "Mode      CPU_freq    Time(us)              Time(%)\n"
+    "SLEEP     40 M        8820354               71%\n"
+    "APB_MIN   40 M        321188                2 %\n"
+    "APB_MAX   80 M        4419                  0 %\n"
+    "CPU_MAX   240M        3218712               26%\n";
+
+static void _test_idf_dump(void) {
+    nir_pm_stats_t stats;
+
+    assert(nir_pm_parse_stats(_idf_dump, &stats));
+    assert(stats.mode_us[NIR_PM_MODE_SLEEP] == 8820354);
+    assert(stats.mode_us[NIR_PM_MODE_APB_MIN] == 321188);
+    assert(stats.mode_us[NIR_PM_MODE_APB_MAX] == 4419);
+    assert(stats.mode_us[NIR_PM_MODE_CPU_MAX] == 3218712);
+
+    assert(!nir_pm_parse_stats("Lock stats:\n", &stats));
+}
+
+static void _dump(nir_pm_stats_t* stats) {
+    char buffer[NIR_PM_DUMP_MAX];
+    FILE* stream = fmemopen(buffer, sizeof buffer, "w");
+
+    esp_pm_dump_locks(stream);
+    fputc('\0', stream);
+    fclose(stream);
+
+    assert(nir_pm_parse_stats(buffer, stats));
+}
+
+static void _test_bursts(void) {
+    nir_pm_stats_t before;
+    nir_pm_stats_t after;
+
+    _dump(&before);
+
+    // every frame stays awake until its final mark is clocked out
+    nir_timer_start_burst(5, NULL);
+    sim_run_for(2000000);
+
+    _dump(&after);
+
+    int64_t awake_us = after.mode_us[NIR_PM_MODE_APB_MIN] - before.mode_us[NIR_PM_MODE_APB_MIN];
+    int64_t frame_us = nir_code_duration_us(nir_code_get(0));
+    printf("apb_min during 5 frames: %lld us, frame: %lld us\n", (long long) awake_us, (long long) frame_us);
+    assert(awake_us >= 5 * frame_us);
+    assert(awake_us <= 5 * (frame_us + 1000));
+
+    // the RMT runs from XTAL, nothing holds APB at its maximum
+    assert(after.mode_us[NIR_PM_MODE_APB_MAX] == before.mode_us[NIR_PM_MODE_APB_MAX]);
+
+    int64_t total = 0;
+    for (int mode = 0; mode < NIR_PM_MODES; mode++) {
+        total += after.mode_us[mode];
+    }
+    assert(total == sim_now());
+}
+
+int main(void) {
+    sim_boot();
+
+    _test_idf_dump();
+    _test_bursts();
+
+    printf("test_pm: pass\n");
+    return 0;
+}
@@ -0,0 +1,211 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sim.h"
+
+#include "nir_ble.h"
+#include "nir_settings.h"
+
+// Reconnect after a disconnect, bonded central with directed advertising
+// against an unbonded one with undirected advertising. The firmware runs as
+// it would, the radio and the central are a model: advertising events on
+// their interval, a central scanning for its pending connection, and link
+// layer procedures a fixed number of connection events long. The times come
+// from the firmware's own NIR_RECONNECT line. One NIR_RECONNECT_MODEL JSON
+// object per case; they compare the two paths, what a device actually
+// achieves needs the hardware and a phone.
+
+#define TRIALS (64)
+
+/// high duty directed advertising, at most 3.75 ms between events
+#define DIRECTED_EVENT_US (3750)
+/// what NimBLE asks for when the params leave the interval 0, at its slowest
+#define UNDIRECTED_INTERVAL_US (60000)
+/// advDelay, a pseudo random 0 to 10 ms added to each undirected event
+#define ADV_DELAY_MAX_US (10000)
+
+/// CONNECT_IND and the transmit window
+#define CONNECT_SETUP_US (2500)
+#define CONN_INTERVAL_US (30000)
+/// encryption restarted with the stored LTK
+#define ENCRYPT_EVENTS (3)
+/// LE Secure Connections Just Works pairing, then key distribution
+#define PAIRING_EVENTS (10)
+/// discovering the service, its characteristics and descriptors
+#define DISCOVERY_EVENTS (12)
+
+#define CONN_HANDLE (1)
+
+typedef struct {
+    const char* name;
+    int64_t interval_us;
+    int64_t window_us;
+} _central_t;
+
+// scan duty cycles in the range phones use while a connection is pending, in
+// the foreground and in the background
+static const _central_t _centrals[] = {
+    { "foreground", 60000, 30000 },
+    { "background", 1280000, 11250 },
+};
+
+typedef struct {
+    int64_t connect_ms;
+    int64_t encrypt_ms;
+    int64_t ready_ms;
+} _reconnect_t;
+
+static const ble_addr_t _peer = { .type = BLE_ADDR_PUBLIC, .val = { 1, 2, 3, 4, 5, 6 } };
+
+static uint32_t _seed = 1;
+
+static uint32_t _random(uint32_t max) {
+    _seed = _seed * 1103515245 + 12345;
+    return (_seed >> 16) % max;
+}
+
+// the first advertising event from start on that falls in a scan window, 0 when none before end
+static int64_t _caught(const _central_t* central, int64_t scan_from, int64_t start, int64_t end, bool directed) {
+    for (int64_t at = start; at < end; at += directed ? DIRECTED_EVENT_US : UNDIRECTED_INTERVAL_US + _random(ADV_DELAY_MAX_US)) {
+        if (at >= scan_from && (at - scan_from) % central->interval_us < central->window_us) {
+            return at;
+        }
+    }
+
+    return 0;
+}
+
+static void _encrypted(void) {
+    struct ble_gap_event event;
+
+    memset(&event, 0, sizeof event);
+    event.type = BLE_GAP_EVENT_ENC_CHANGE;
+    event.enc_change.status = 0;
+    event.enc_change.conn_handle = CONN_HANDLE;
+
+    sim_ble_gap_event(&event);
+}
+
+// the central's first read, with the firmware's NIR_RECONNECT line taken off stdout
+static _reconnect_t _ready(bool* directed) {
+    const nir_setting_t* setting = nir_settings_find("enabled");
+    uint8_t value[sizeof (uint32_t)];
+    uint16_t len = sizeof value;
+    char line[256] = "";
+    _reconnect_t reconnect;
+    char flag[8];
+
+    FILE* capture = tmpfile();
+    int saved = dup(STDOUT_FILENO);
+
+    fflush(stdout);
+    dup2(fileno(capture), STDOUT_FILENO);
+    assert(sim_ble_gatt_access(CONN_HANDLE, setting - nir_settings, BLE_GATT_ACCESS_OP_READ_CHR, NULL, 0, value, &len) == 0);
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+
+    rewind(capture);
+    while (fgets(line, sizeof line, capture) && !strstr(line, "NIR_RECONNECT {")) {
+    }
+    fclose(capture);
+
+    assert(strstr(line, "NIR_RECONNECT {"));
+    assert(sscanf(strstr(line, "NIR_RECONNECT {"),
+        "NIR_RECONNECT {\"directed\":%7[a-z],\"connect_ms\":%lld,\"encrypt_ms\":%lld,\"ready_ms\":%lld}",
+        flag, &reconnect.connect_ms, &reconnect.encrypt_ms, &reconnect.ready_ms) == 4);
+    *directed = strcmp(flag, "true") == 0;
+
+    return reconnect;
+}
+
+static _reconnect_t _reconnect(const _central_t* central, bool bonded, int64_t phase_us) {
+    int64_t disconnected = sim_now();
+    sim_ble_disconnect(0x213); // remote user terminated
+
+    // the central starts scanning for it a moment later
+    int64_t scan_from = disconnected + phase_us;
+    const sim_adv_t* adv = sim_ble_adv(NIR_ADV_INSTANCE_1M);
+    assert(adv->active && adv->params.own_addr_type == BLE_OWN_ADDR_RPA_PUBLIC_DEFAULT);
+
+    int64_t caught = 0;
+    if (adv->params.directed) {
+        int64_t end = adv->started_at + adv->duration * 10000LL;
+
+        caught = _caught(central, scan_from, adv->started_at, end, true);
+        if (!caught) {
+            sim_run_until(end);
+            sim_ble_adv_complete(NIR_ADV_INSTANCE_1M, BLE_HS_ETIMEOUT);
+            assert(adv->active && !adv->params.directed);
+        }
+    }
+    if (!caught) {
+        caught = _caught(central, scan_from, adv->started_at, INT64_MAX, false);
+    }
+
+    sim_run_until(caught + CONNECT_SETUP_US);
+    sim_ble_connect(CONN_HANDLE, &_peer, bonded);
+
+    sim_run_for((bonded ? ENCRYPT_EVENTS : PAIRING_EVENTS) * CONN_INTERVAL_US);
+    _encrypted();
+
+    // with handles cached the first access follows, without them discovery comes first
+    sim_run_for((bonded ? 1 : DISCOVERY_EVENTS) * CONN_INTERVAL_US);
+
+    bool directed;
+    _reconnect_t reconnect = _ready(&directed);
+    assert(directed == bonded);
+
+    return reconnect;
+}
+
+static int _compare(const void* a, const void* b) {
+    int64_t x = *(const int64_t*) a;
+    int64_t y = *(const int64_t*) b;
+
+    return (x > y) - (x < y);
+}
+
+// median ready time
+static int64_t _case(const _central_t* central, bool bonded) {
+    static int64_t connect[TRIALS];
+    static int64_t ready[TRIALS];
+
+    sim_ble_connect(CONN_HANDLE, &_peer, bonded);
+    sim_run_for(CONN_INTERVAL_US);
+
+    // the central starts scanning anywhere within its interval
+    for (uint16_t i = 0; i < TRIALS; i++) {
+        _reconnect_t reconnect = _reconnect(central, bonded, central->interval_us * i / TRIALS);
+        connect[i] = reconnect.connect_ms;
+        ready[i] = reconnect.ready_ms;
+    }
+
+    qsort(connect, TRIALS, sizeof connect[0], _compare);
+    qsort(ready, TRIALS, sizeof ready[0], _compare);
+
+    printf("NIR_RECONNECT_MODEL {\"case\":\"%s\",\"central\":\"%s\",\"trials\":%u,\"connect_ms\":%lld,"
+        "\"ready_ms\":%lld,\"max_ready_ms\":%lld}\n", bonded ? "bonded_directed" : "unbonded_undirected",
+        central->name, TRIALS, (long long) connect[TRIALS / 2], (long long) ready[TRIALS / 2],
+        (long long) ready[TRIALS - 1]);
+
+    return ready[TRIALS / 2];
+}
+
+int main(void) {
+    sim_boot();
+    assert(sim_ble_privacy() == 1);
+
+    for (size_t i = 0; i < sizeof _centrals / sizeof _centrals[0]; i++) {
+        int64_t directed = _case(&_centrals[i], true);
+        int64_t undirected = _case(&_centrals[i], false);
+
+        assert(directed < undirected);
+    }
+
+    printf("test_reconnect: pass\n");
+    return 0;
+}
@@ -0,0 +1,155 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sim.h"
+
+#include "nir_code.h"
+#include "nir_schedule.h"
+#include "nir_settings.h"
+#include "nir_timer.h"
+
+// A daily window over several days on the virtual clock, with the central
+// syncing the time every hour the way the app does on each connection.
+// Shots start on every opening, stop on every close and run undisturbed in
+// between; a sync or edit that leaves the window where it was reschedules
+// nothing.
+
+void _nir_control_run(void);
+
+/// 2021-06-01 00:00:00 UTC
+#define WALL_S (1622505600)
+#define HOUR_S (3600)
+#define DAY_S (86400)
+
+#define DAYS (4)
+#define DELAY_MS (30000)
+
+/// 01:00 to 03:00 every day
+#define OPEN_S (WALL_S + 1 * HOUR_S)
+#define CLOSE_S (WALL_S + 3 * HOUR_S)
+
+#define FRAMES_MAX (4096)
+
+static int64_t _frames[FRAMES_MAX];
+static int64_t _period_us;
+static int64_t _frame_us;
+
+static void _write(const char* name, uint32_t value) {
+    const nir_setting_t* setting = nir_settings_find(name);
+    uint8_t buffer[sizeof (uint32_t)];
+
+    for (uint16_t i = 0; i < nir_setting_size(setting); i++) {
+        buffer[i] = (value >> (8 * i)) & 0xFF;
+    }
+
+    assert(sim_ble_gatt_access(1, setting - nir_settings, BLE_GATT_ACCESS_OP_WRITE_CHR, buffer,
+        nir_setting_size(setting), NULL, NULL) == 0);
+}
+
+// the control task wakes on every notification and once a second
+static void _control(void* arg) {
+    _nir_control_run();
+}
+
+static void _after_callback(void) {
+    if (sim_task_take_notify("nir_control")) {
+        _nir_control_run();
+    }
+}
+
+// virtual clock to wall clock, the sim starts at WALL_S
+static int64_t _wall_us(int64_t at) {
+    return (int64_t) WALL_S * 1000000 + at;
+}
+
+static void _test_days(void) {
+    uint32_t reschedules = nir_timer_get_reschedules();
+
+    sim_rmt_log_frames(_frames, FRAMES_MAX);
+    _write("enabled", 1);
+
+    // hourly syncs on the second, the clock has not drifted
+    for (uint32_t hour = 1; hour <= DAYS * 24; hour++) {
+        sim_run_until((int64_t) hour * HOUR_S * 1000000);
+        _write("time", WALL_S + hour * HOUR_S);
+    }
+
+    size_t frames = sim_rmt_logged_frames();
+    size_t n = 0;
+
+    for (uint32_t day = 0; day < DAYS; day++) {
+        int64_t open = (int64_t) (OPEN_S + day * DAY_S) * 1000000;
+        int64_t close = (int64_t) (CLOSE_S + day * DAY_S) * 1000000;
+        size_t first = n;
+
+        // the camera fires on the final mark, so the first frame starts a frame ahead of the opening
+        assert(n < frames && llabs(_wall_us(_frames[n]) - (open - _frame_us)) < 1000);
+
+        for (n++; n < frames && _wall_us(_frames[n]) < close; n++) {
+            assert(_frames[n] - _frames[n - 1] == _period_us);
+        }
+
+        printf("day %u: %zu frames\n", day, n - first);
+        assert((int64_t) (n - first) == (close - open + _frame_us + _period_us - 1) / _period_us);
+    }
+    assert(n == frames);
+
+    // enabled, then each close schedules the next opening, the syncs nothing
+    printf("reschedules: %u\n", nir_timer_get_reschedules() - reschedules);
+    assert(nir_timer_get_reschedules() - reschedules == 1 + DAYS);
+}
+
+static void _test_unchanged(void) {
+    int64_t day = (int64_t) DAYS * DAY_S;
+    uint32_t reschedules = nir_timer_get_reschedules();
+
+    // inside the window the close moving only re-arms the boundary
+    sim_run_until((day + 2 * HOUR_S) * 1000000);
+    _write("windowstop", CLOSE_S + HOUR_S);
+    assert(nir_timer_get_reschedules() == reschedules);
+
+    // one that has already passed closes it until tomorrow
+    _write("windowstop", OPEN_S + HOUR_S / 2);
+    assert(nir_timer_get_reschedules() == reschedules + 1);
+    reschedules = nir_timer_get_reschedules();
+
+    // closed, a sync half a second behind leaves the opening within the slack
+    sim_run_until((day + 4 * HOUR_S) * 1000000 + 500000);
+    _write("time", WALL_S + day + 4 * HOUR_S);
+    assert(nir_timer_get_reschedules() == reschedules);
+
+    // an opening a minute later has the shots wait for it
+    _write("windowstart", OPEN_S + 60);
+    assert(nir_timer_get_reschedules() == reschedules + 1);
+}
+
+int main(void) {
+    const esp_timer_create_args_t control_args = {
+        .name = "control",
+        .callback = _control,
+    };
+    esp_timer_handle_t control_timer;
+
+    sim_boot();
+    sim_set_wall_us((int64_t) WALL_S * 1000000);
+    sim_set_after_callback(_after_callback);
+
+    ESP_ERROR_CHECK(esp_timer_create(&control_args, &control_timer));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(control_timer, NIR_CONTROL_INTERVAL_MS * 1000));
+
+    _frame_us = nir_code_duration_us(nir_code_get(nir_get_protocol()));
+    _period_us = _frame_us + DELAY_MS * 1000;
+
+    _write("time", WALL_S);
+    _write("windowstart", OPEN_S);
+    _write("windowstop", CLOSE_S);
+    _write("windowrepeat", 1);
+    _write("delayms", DELAY_MS);
+
+    _test_days();
+    _test_unchanged();
+
+    printf("test_schedule: pass\n");
+    return 0;
+}
@@ -0,0 +1,224 @@
+#include <assert.h>
+#include <poll.h>
+#include <pty.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sim.h"
+
+#include "nir_serial.h"
+#include "nir_settings.h"
+
+// The serial task on a host thread behind a pseudo terminal, driven the way
+// a bench rig would: one request at a time for the round trip, then a
+// pipelined run for throughput. One NIR_SERIAL JSON object per case.
+
+#define ROUND_TRIPS (200)
+#define PIPELINED (2000)
+
+/// a request must not wait on a read timeout, which used to be 100 ms
+#define MAX_MEDIAN_RTT_US (10000)
+
+static int _host = -1;
+static uint8_t _sequence = 0;
+
+static int64_t _now_us(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (int64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static void _raw(int fd) {
+    struct termios tio;
+
+    assert(tcgetattr(fd, &tio) == 0);
+    cfmakeraw(&tio);
+    assert(tcsetattr(fd, TCSANOW, &tio) == 0);
+}
+
+static size_t _frame(uint8_t* frame, uint8_t opcode, uint8_t sequence, const uint8_t* payload, uint8_t len) {
+    frame[0] = NIR_SERIAL_SYNC;
+    frame[1] = 2 + len;
+    frame[2] = opcode;
+    frame[3] = sequence;
+    memcpy(&frame[4], payload, len);
+
+    uint16_t crc = nir_serial_crc16(&frame[1], 3 + len);
+    frame[4 + len] = crc & 0xFF;
+    frame[5 + len] = crc >> 8;
+
+    return 6 + len;
+}
+
+static void _send(uint8_t opcode, const uint8_t* payload, uint8_t len) {
+    uint8_t frame[6 + NIR_SERIAL_MAX_PAYLOAD];
+    size_t size = _frame(frame, opcode, _sequence++, payload, len);
+
+    assert(write(_host, frame, size) == (ssize_t) size);
+}
+
+static void _read_exactly(uint8_t* buffer, size_t len) {
+    struct pollfd pfd = { .fd = _host, .events = POLLIN };
+    size_t received = 0;
+
+    while (received < len) {
+        assert(poll(&pfd, 1, 5000) == 1);
+
+        ssize_t n = read(_host, buffer + received, len - received);
+        assert(n > 0);
+        received += n;
+    }
+}
+
+// returns the status, checks the frame, sequence and opcode
+static uint8_t _reply(uint8_t opcode, uint8_t sequence, uint8_t* payload, uint8_t* len) {
+    uint8_t reply[4 + 2 + NIR_SERIAL_MAX_PAYLOAD];
+
+    _read_exactly(reply, 2);
+    assert(reply[0] == NIR_SERIAL_SYNC);
+    // replies are bounded like requests, the status counts as payload
+    assert(reply[1] >= 3 && reply[1] <= 2 + NIR_SERIAL_MAX_PAYLOAD);
+    _read_exactly(&reply[2], reply[1] + 2);
+
+    uint16_t crc = nir_serial_crc16(&reply[1], 1 + reply[1]);
+    assert(reply[2 + reply[1]] == (crc & 0xFF) && reply[3 + reply[1]] == crc >> 8);
+    assert(reply[2] == (opcode | NIR_SERIAL_REPLY));
+    assert(reply[3] == sequence);
+
+    if (payload) {
+        *len = reply[1] - 3;
+        memcpy(payload, &reply[5], *len);
+    }
+
+    return reply[4];
+}
+
+static int _compare(const void* a, const void* b) {
+    int64_t x = *(const int64_t*) a;
+    int64_t y = *(const int64_t*) b;
+
+    return (x > y) - (x < y);
+}
+
+static void _test_round_trip(void) {
+    static int64_t rtts[ROUND_TRIPS];
+    const uint8_t setting = nir_settings_find("delayms") - nir_settings;
+
+    for (uint16_t i = 0; i < ROUND_TRIPS; i++) {
+        uint8_t sequence = _sequence;
+        uint8_t value[4];
+        uint8_t len;
+
+        int64_t start = _now_us();
+        _send(NIR_SERIAL_OP_READ, &setting, 1);
+        assert(_reply(NIR_SERIAL_OP_READ, sequence, value, &len) == NIR_SERIAL_OK);
+        rtts[i] = _now_us() - start;
+
+        assert(len == nir_setting_size(&nir_settings[setting]));
+    }
+
+    qsort(rtts, ROUND_TRIPS, sizeof rtts[0], _compare);
+
+    printf("NIR_SERIAL {\"case\":\"round_trip\",\"ops\":%u,\"median_us\":%lld,\"p99_us\":%lld,\"max_us\":%lld}\n",
+        ROUND_TRIPS, (long long) rtts[ROUND_TRIPS / 2], (long long) rtts[ROUND_TRIPS * 99 / 100],
+        (long long) rtts[ROUND_TRIPS - 1]);
+
+    assert(rtts[ROUND_TRIPS / 2] < MAX_MEDIAN_RTT_US);
+}
+
+// requests written back to back while replies are read, replies in order
+static void _test_pipelined(void) {
+    const uint8_t payload[] = { 'n', 'i', 'r', 0 };
+    uint8_t first = _sequence;
+
+    int64_t start = _now_us();
+
+    pid_t writer = fork();
+    assert(writer >= 0);
+    if (writer == 0) {
+        for (uint16_t i = 0; i < PIPELINED; i++) {
+            _send(NIR_SERIAL_OP_ECHO, payload, sizeof payload);
+        }
+        _exit(0);
+    }
+
+    for (uint16_t i = 0; i < PIPELINED; i++) {
+        uint8_t echo[NIR_SERIAL_MAX_PAYLOAD];
+        uint8_t len;
+
+        assert(_reply(NIR_SERIAL_OP_ECHO, (uint8_t) (first + i), echo, &len) == NIR_SERIAL_OK);
+        assert(len == sizeof payload && memcmp(echo, payload, len) == 0);
+    }
+
+    int64_t elapsed = _now_us() - start;
+    _sequence += PIPELINED;
+
+    printf("NIR_SERIAL {\"case\":\"pipelined\",\"ops\":%u,\"ops_per_s\":%.0f,\"mean_us\":%.1f}\n",
+        PIPELINED, 1e6 * PIPELINED / elapsed, (double) elapsed / PIPELINED);
+}
+
+// a bad CRC is dropped and the next frame still gets through
+static void _test_resync(void) {
+    uint8_t frame[6 + NIR_SERIAL_MAX_PAYLOAD];
+    size_t size = _frame(frame, NIR_SERIAL_OP_COUNT, _sequence++, NULL, 0);
+
+    frame[size - 1] ^= 0xFF;
+    assert(write(_host, frame, size) == (ssize_t) size);
+
+    uint8_t sequence = _sequence;
+    uint8_t count;
+    uint8_t len;
+
+    _send(NIR_SERIAL_OP_COUNT, NULL, 0);
+    assert(_reply(NIR_SERIAL_OP_COUNT, sequence, &count, &len) == NIR_SERIAL_OK);
+    assert(len == 1 && count == nir_settings_count);
+}
+
+// the longest echo fits a reply with its status, a full payload does not
+static void _test_echo_length(void) {
+    uint8_t payload[NIR_SERIAL_MAX_PAYLOAD];
+    uint8_t echo[NIR_SERIAL_MAX_PAYLOAD];
+    uint8_t sequence;
+    uint8_t len;
+
+    for (uint8_t i = 0; i < sizeof payload; i++) {
+        payload[i] = i;
+    }
+
+    sequence = _sequence;
+    _send(NIR_SERIAL_OP_ECHO, payload, NIR_SERIAL_MAX_PAYLOAD - 1);
+    assert(_reply(NIR_SERIAL_OP_ECHO, sequence, echo, &len) == NIR_SERIAL_OK);
+    assert(len == NIR_SERIAL_MAX_PAYLOAD - 1 && memcmp(echo, payload, len) == 0);
+
+    sequence = _sequence;
+    _send(NIR_SERIAL_OP_ECHO, payload, NIR_SERIAL_MAX_PAYLOAD);
+    assert(_reply(NIR_SERIAL_OP_ECHO, sequence, echo, &len) == NIR_SERIAL_BAD_LENGTH);
+    assert(len == 0);
+}
+
+int main(void) {
+    int device;
+
+    assert(openpty(&_host, &device, NULL, NULL, NULL) == 0);
+    _raw(_host);
+    _raw(device);
+
+    sim_boot();
+
+    sim_uart_attach(NIR_SERIAL_UART, device);
+    nir_serial_init();
+    assert(sim_task_start("nir_serial"));
+
+    _test_resync();
+    _test_echo_length();
+    _test_round_trip();
+    _test_pipelined();
+
+    printf("test_serial: pass\n");
+    return 0;
+}
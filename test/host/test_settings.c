@@ -0,0 +1,152 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sim.h"
+
+#include "nikon_ir_remote.h"
+#include "nir_code.h"
+#include "nir_preset.h"
+#include "nir_settings.h"
+#include "nir_timer.h"
+
+// Writes through the GATT path: preset deactivation, protocol validation, a
+// protocol change while the timelapse is running and a preset activated
+// during a burst.
+
+static int _write(const char* name, uint32_t value) {
+    const nir_setting_t* setting = nir_settings_find(name);
+    uint8_t buffer[sizeof (uint32_t)];
+
+    for (uint16_t i = 0; i < nir_setting_size(setting); i++) {
+        buffer[i] = (value >> (8 * i)) & 0xFF;
+    }
+
+    return sim_ble_gatt_access(1, setting - nir_settings, BLE_GATT_ACCESS_OP_WRITE_CHR, buffer,
+        nir_setting_size(setting), NULL, NULL);
+}
+
+// what nir_settings_load would read back, a key never written loads the default
+static uint16_t _stored(const char* key) {
+    uint16_t value = 0;
+
+    if (sim_nvs_get_u16(key, &value)) {
+        return value;
+    }
+
+    for (uint16_t i = 0; i < nir_settings_count; i++) {
+        if (nir_settings[i].nvs_key && strcmp(nir_settings[i].nvs_key, key) == 0) {
+            return nir_settings[i].default_value;
+        }
+    }
+
+    assert(!"no such key");
+    return 0;
+}
+
+// Learned slot 0 in the format nir_learn stores: carrier, duty, count, then
+// every mark and space as a zigzag varint delta in 10 us units.
+static void _learned_code(void) {
+    static const uint16_t durations[] = { 9000, 4500, 560, 560, 560, 1690, 560 };
+    uint8_t blob[64] = { 38000 & 0xFF, 38000 >> 8, 33, sizeof durations / sizeof durations[0] };
+    int32_t previous[2] = { 0, 0 };
+    size_t len = 4;
+
+    for (uint16_t i = 0; i < sizeof durations / sizeof durations[0]; i++) {
+        int32_t delta = durations[i] / 10 - previous[i % 2];
+        uint32_t zigzag = ((uint32_t) delta << 1) ^ (uint32_t) (delta >> 31);
+
+        previous[i % 2] = durations[i] / 10;
+        do {
+            blob[len++] = (zigzag & 0x7F) | (zigzag >> 7 ? 0x80 : 0);
+            zigzag >>= 7;
+        } while (zigzag);
+    }
+
+    assert(sim_nvs_set_blob("nir_learn0", blob, len));
+}
+
+static void _test_preset_deactivation(void) {
+    const nir_preset_t* night = nir_preset_get(2);
+
+    assert(_write("preset", 2) == 0);
+    assert(nir_get_delayms() == night->delayms);
+    assert(_stored(NIR_PRESET_NVS_KEY) == 2);
+
+    // individual write ends the preset, what it applied is now stored as the settings
+    assert(_write("carrierhz", 40000) == 0);
+    assert(nir_get_preset() == NIR_PRESET_NONE);
+    assert(_stored(NIR_PRESET_NVS_KEY) == NIR_PRESET_NONE);
+    assert(_stored("nir_delayms") == night->delayms);
+    assert(_stored("nir_carrierhz") == 40000);
+    assert(_stored("nir_protocol") == night->protocol);
+    assert(_stored("nir_duty") == night->duty);
+}
+
+static void _test_protocol_validation(void) {
+    uint16_t protocol = nir_get_protocol();
+
+    // slot 1 has nothing learned
+    assert(_write("protocol", NIR_CODES_BUILTIN + 1) == BLE_ATT_ERR_VALUE_NOT_ALLOWED);
+    assert(nir_get_protocol() == protocol);
+    assert(_stored("nir_protocol") == protocol);
+
+    assert(_write("protocol", NIR_CODES_BUILTIN + 0) == 0);
+    assert(nir_get_protocol() == NIR_CODES_BUILTIN);
+    assert(_stored("nir_protocol") == NIR_CODES_BUILTIN);
+}
+
+static void _test_protocol_while_running(void) {
+    assert(_write("protocol", 0) == 0);
+    assert(_write("delayms", 100) == 0);
+    assert(_write("enabled", 1) == 0);
+
+    sim_run_for(6000000);
+    uint32_t frames = sim_rmt_frames();
+    assert(frames > 0);
+
+    // lands mid frame at some point, the swap must never cut into one
+    for (int i = 0; i < 20; i++) {
+        assert(_write("protocol", i % 2 ? 0 : NIR_CODES_BUILTIN) == 0);
+        sim_run_for(6000000 + i * 7000);
+    }
+
+    assert(sim_rmt_frames() > frames);
+    assert(sim_rmt_overlaps() == 0);
+    assert(sim_rmt_disturbed() == 0);
+
+    assert(_write("enabled", 0) == 0);
+}
+
+// a preset swaps the code, a burst still clocking out is cut short first
+static void _test_preset_while_running(void) {
+    const nir_preset_t* night = nir_preset_get(2);
+    assert(night->protocol != NIR_CODES_BUILTIN);
+
+    // lands mid frame at some point, as in the protocol case
+    for (int i = 0; i < 20; i++) {
+        assert(_write("protocol", NIR_CODES_BUILTIN) == 0);
+        assert(_write("burst", 10) == 0);
+        sim_run_for(3000 + i * 7000);
+
+        assert(_write("preset", 2) == 0);
+        assert(nir_timer_frames_remaining() == 0);
+        sim_run_for(1000000);
+    }
+
+    assert(sim_rmt_overlaps() == 0);
+    assert(sim_rmt_disturbed() == 0);
+}
+
+int main(void) {
+    _learned_code();
+    sim_boot();
+
+    _test_preset_deactivation();
+    _test_protocol_validation();
+    _test_protocol_while_running();
+    _test_preset_while_running();
+
+    printf("test_settings: pass\n");
+    return 0;
+}
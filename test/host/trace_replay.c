@@ -0,0 +1,282 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sim.h"
+
+#include "nir_nvs.h"
+#include "nir_settings.h"
+#include "nir_timer.h"
+#include "nir_trace.h"
+
+// Replays a trace recorded on the device, or a synthetic high rate one,
+// through the GATT access callback and the GAP event handler on the virtual
+// clock, each entry at its recorded offset. Reports the host time of every
+// access, and what the load did to the control path: timer reschedules, NVS
+// commits and the frames the RMT clocked out. One NIR_TRACE_REPLAY JSON
+// object per run.
+//
+// usage: nir_trace_replay [trace]
+//
+// A trace is the serial log captured while the trace characteristic went
+// from NIR_TRACE_CMD_RECORD to NIR_TRACE_CMD_STOP, lines other than
+// NIR_TRACE ones are ignored.
+
+#define ENTRIES_MAX (4096)
+#define FRAMES_MAX (4096)
+
+/// alternating reads and delayms writes, as a slider dragged in an app
+#define SYNTHETIC_OPS (2000)
+#define SYNTHETIC_GAP_US (1000)
+/// enabled a few frames ahead of the load
+#define SYNTHETIC_LOAD_AT_US (8000000)
+
+/// run on after the last entry so late or lost frames show
+#define TAIL_US (10000000)
+
+#define CONN_HANDLE (1)
+
+typedef struct {
+    int64_t at_us;
+    uint8_t kind;
+    uint8_t id;
+    char name[16];
+    uint32_t value;
+} _entry_t;
+
+// Rows whose access only touches RAM state and the timer. Not presetsave,
+// which writes flash, learn, which starts the RX task, time, which moves the
+// wall clock the windows are measured against, the windows themselves, which
+// only mean something against the wall clock of the recording, or trace.
+static const char* const _replayed[] = {
+    "enabled", "delayms", "burst", "bulbms", "carrierhz", "duty", "protocol", "preset",
+    "link", "recoveries", "missed", "heapallocs",
+};
+
+static _entry_t _entries[ENTRIES_MAX];
+static size_t _count = 0;
+
+static int64_t _latencies_ns[ENTRIES_MAX];
+static int64_t _frames[FRAMES_MAX];
+
+static int64_t _now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static int _compare(const void* a, const void* b) {
+    int64_t x = *(const int64_t*) a;
+    int64_t y = *(const int64_t*) b;
+
+    return (x > y) - (x < y);
+}
+
+static const nir_setting_t* _replayable(const char* name) {
+    for (size_t i = 0; i < sizeof _replayed / sizeof _replayed[0]; i++) {
+        if (strcmp(name, _replayed[i]) == 0) {
+            return nir_settings_find(name);
+        }
+    }
+
+    return NULL;
+}
+
+static void _add(int64_t at_us, uint8_t kind, uint8_t id, const char* name, uint32_t value) {
+    assert(_count < ENTRIES_MAX);
+
+    _entry_t* entry = &_entries[_count++];
+    entry->at_us = at_us;
+    entry->kind = kind;
+    entry->id = id;
+    snprintf(entry->name, sizeof entry->name, "%s", name);
+    entry->value = value;
+}
+
+// the text after "key": in a NIR_TRACE line
+static const char* _field(const char* line, const char* key) {
+    char quoted[24];
+    snprintf(quoted, sizeof quoted, "\"%s\":", key);
+
+    const char* at = strstr(line, quoted);
+    return at ? at + strlen(quoted) : NULL;
+}
+
+static void _load(const char* path) {
+    char line[256];
+    FILE* file = fopen(path, "r");
+
+    if (!file) {
+        perror(path);
+        exit(1);
+    }
+
+    while (fgets(line, sizeof line, file)) {
+        const char* json = strstr(line, "NIR_TRACE {");
+        if (!json) {
+            continue;
+        }
+
+        const char* at_us = _field(json, "at_us");
+        const char* kind = _field(json, "kind");
+        const char* id = _field(json, "id");
+        const char* name = _field(json, "name");
+        const char* value = _field(json, "value");
+
+        if (!at_us || !kind || !id || !name || !value) {
+            fprintf(stderr, "trace_replay: malformed: %s", line);
+            exit(1);
+        }
+
+        char setting[16] = "";
+        sscanf(name, "\"%15[^\"]", setting);
+
+        _add(strtoll(at_us, NULL, 10),
+            strncmp(kind, "\"gap\"", 5) == 0 ? NIR_TRACE_GAP
+                : strncmp(kind, "\"write\"", 7) == 0 ? NIR_TRACE_WRITE : NIR_TRACE_READ,
+            strtoul(id, NULL, 10), setting, strtoul(value, NULL, 10));
+    }
+
+    fclose(file);
+}
+
+static void _synthetic(void) {
+    _add(0, NIR_TRACE_GAP, BLE_GAP_EVENT_CONNECT, "", 0);
+    _add(0, NIR_TRACE_WRITE, 0, "delayms", 1000);
+    _add(0, NIR_TRACE_WRITE, 0, "enabled", 1);
+
+    for (uint32_t n = 0; n < SYNTHETIC_OPS; n++) {
+        int64_t at_us = SYNTHETIC_LOAD_AT_US + n * SYNTHETIC_GAP_US;
+
+        if (n % 2) {
+            _add(at_us, NIR_TRACE_WRITE, 0, "delayms", n % 4 == 1 ? 1500 : 1000);
+        } else {
+            _add(at_us, NIR_TRACE_READ, 0, n % 4 ? "missed" : "delayms", 0);
+        }
+    }
+
+    _add(SYNTHETIC_LOAD_AT_US + SYNTHETIC_OPS * SYNTHETIC_GAP_US, NIR_TRACE_GAP,
+        BLE_GAP_EVENT_DISCONNECT, "", 0x213); // remote user terminated
+}
+
+// false when the entry is skipped
+static bool _replay(const _entry_t* entry, bool* connected, int64_t* latency_ns) {
+    const ble_addr_t peer = { .type = BLE_ADDR_RANDOM, .val = { 1, 2, 3, 4, 5, 0xC6 } };
+
+    if (entry->kind == NIR_TRACE_GAP) {
+        // through the simulator so every event is one the stack could deliver
+        if (entry->id == BLE_GAP_EVENT_CONNECT && entry->value == 0 && !*connected) {
+            sim_ble_connect(CONN_HANDLE, &peer, false);
+            *connected = true;
+            return true;
+        } else if (entry->id == BLE_GAP_EVENT_DISCONNECT && *connected) {
+            sim_ble_disconnect(entry->value);
+            *connected = false;
+            return true;
+        }
+
+        return false;
+    }
+
+    const nir_setting_t* setting = _replayable(entry->name);
+    if (!setting) {
+        return false;
+    }
+
+    uint8_t value[sizeof (uint32_t)];
+    uint16_t len = nir_setting_size(setting);
+    uint8_t out[sizeof (uint32_t)];
+    uint16_t out_len = sizeof out;
+
+    for (uint16_t i = 0; i < len; i++) {
+        value[i] = (entry->value >> (8 * i)) & 0xFF;
+    }
+
+    int64_t start = _now_ns();
+    int rc = entry->kind == NIR_TRACE_WRITE
+        ? sim_ble_gatt_access(CONN_HANDLE, setting - nir_settings, BLE_GATT_ACCESS_OP_WRITE_CHR, value, len, NULL, NULL)
+        : sim_ble_gatt_access(CONN_HANDLE, setting - nir_settings, BLE_GATT_ACCESS_OP_READ_CHR, NULL, 0, out, &out_len);
+    *latency_ns = _now_ns() - start;
+
+    // the device accepted every entry it recorded
+    if (rc) {
+        fprintf(stderr, "trace_replay: %s %s: %d\n", entry->kind == NIR_TRACE_WRITE ? "write" : "read",
+            entry->name, rc);
+        exit(1);
+    }
+
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const char* source = argc > 1 ? argv[1] : "synthetic";
+    bool connected = false;
+    size_t ops = 0;
+    size_t skipped = 0;
+
+    sim_boot();
+
+    if (argc > 1) {
+        _load(argv[1]);
+    } else {
+        _synthetic();
+    }
+    assert(_count > 0);
+
+    uint32_t reschedules = nir_timer_get_reschedules();
+    uint32_t commits = nir_nvs_get_commits();
+    uint32_t missed = nir_timer_get_missed();
+    uint32_t overlaps = sim_rmt_overlaps();
+    uint32_t disturbed = sim_rmt_disturbed();
+    nir_timer_take_max_lateus();
+
+    int64_t start = sim_now();
+    sim_rmt_log_frames(_frames, FRAMES_MAX);
+
+    for (size_t n = 0; n < _count; n++) {
+        int64_t at = start + _entries[n].at_us;
+        int64_t latency_ns = 0;
+
+        if (at > sim_now()) {
+            sim_run_until(at);
+        }
+
+        if (!_replay(&_entries[n], &connected, &latency_ns)) {
+            skipped++;
+        } else if (_entries[n].kind != NIR_TRACE_GAP) {
+            _latencies_ns[ops++] = latency_ns;
+        }
+    }
+
+    sim_run_for(TAIL_US);
+
+    size_t frames = sim_rmt_logged_frames();
+    int64_t max_gap_us = 0;
+    for (size_t i = 1; i < frames; i++) {
+        int64_t gap = _frames[i] - _frames[i - 1];
+        max_gap_us = gap > max_gap_us ? gap : max_gap_us;
+    }
+
+    qsort(_latencies_ns, ops, sizeof _latencies_ns[0], _compare);
+
+    printf("NIR_TRACE_REPLAY {\"trace\":\"%s\",\"entries\":%zu,\"ops\":%zu,\"skipped\":%zu,"
+        "\"median_us\":%.2f,\"p99_us\":%.2f,\"max_us\":%.2f,\"reschedules\":%u,\"nvs_commits\":%u,"
+        "\"frames\":%zu,\"max_gap_us\":%lld,\"missed\":%u,\"max_late_us\":%lld,\"overlaps\":%u,\"disturbed\":%u}\n",
+        source, _count, ops, skipped,
+        ops ? _latencies_ns[ops / 2] / 1000.0 : 0, ops ? _latencies_ns[ops * 99 / 100] / 1000.0 : 0,
+        ops ? _latencies_ns[ops - 1] / 1000.0 : 0,
+        nir_timer_get_reschedules() - reschedules, nir_nvs_get_commits() - commits,
+        frames, (long long) max_gap_us, nir_timer_get_missed() - missed,
+        (long long) nir_timer_take_max_lateus(),
+        sim_rmt_overlaps() - overlaps, sim_rmt_disturbed() - disturbed);
+
+    // no frame cut into or clocked out on a reconfigured channel
+    assert(sim_rmt_overlaps() == overlaps);
+    assert(sim_rmt_disturbed() == disturbed);
+
+    printf("trace_replay: pass\n");
+    return 0;
+}